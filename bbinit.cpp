@@ -17,30 +17,11 @@
 */
 
 #include "bbinit.h"
+#if USE_PEXT
+#include <immintrin.h>
+#endif
 
 
-/**
- * @brief Our implementation of a xorshift generator as discovered by George
- * Marsaglia.
- * This specific implementation is not fully pseudorandom, but attempts to
- * create good magic number candidates by artifically increasing the number
- * of high bits.
- */
-static uint64_t mseed = 0, mstate = 0;
-uint64_t magicRNG() {
-    // Use "y" to achieve a larger number of high bits
-    uint64_t y = ((mstate << 57) | (mseed << 57)) >> 1;
-    mstate ^= mseed >> 17;
-    mstate ^= mstate << 3;
-
-    uint64_t temp = mseed;
-    mseed = mstate;
-    mstate = temp;
-
-    // But not too high, or they will overflow out once multiplied by the mask
-    return (y | (mseed ^ mstate)) >> 1;
-}
-
 // Shift amounts for Dumb7fill
 const int NORTH_SOUTH_FILL = 8;
 const int EAST_WEST_FILL = 1;
@@ -54,8 +35,10 @@ uint64_t fillRayLeft(uint64_t rayPieces, uint64_t empty, int shift);
 // Masks the relevant rook or bishop occupancy bits for magic bitboards
 static uint64_t ROOK_MASK[64];
 static uint64_t BISHOP_MASK[64];
-// The full attack table containing all attack sets of bishops and rooks
-uint64_t *attackTable;
+// The full attack table containing all attack sets of bishops and rooks.
+// It has 107648 entries, found by summing the 2^(# relevant bits) for all
+// squares of both bishops and rooks
+static uint64_t attackTable[107648];
 // The magic values for bishops, one for each square
 MagicInfo magicBishops[64];
 // The magic values for rooks, one for each square
@@ -68,7 +51,46 @@ uint64_t indexToMask64(int index, int nBits, uint64_t mask);
 uint64_t ratt(int sq, uint64_t block);
 uint64_t batt(int sq, uint64_t block);
 int magicMap(uint64_t masked, uint64_t magic, int nBits);
-uint64_t findMagic(int sq, int m, bool isBishop);
+
+// Precomputed magic numbers, found by trial and error with Tord Romstad's
+// approach (sparse random candidates from a xorshift generator)
+static const uint64_t BISHOP_MAGICS[64] = {
+0x3e40902222004210, 0x38a0414c00a08000, 0x3490044088280602, 0x1604070200900202,
+0x3d82021100100000, 0x2e81100290010100, 0x7f82020120084202, 0x6a81008041084020,
+0x3a80046002242100, 0x3b01908491004200, 0x3f00b02506082420, 0x2b82280481100001,
+0x3780040504002403, 0x1588008821080808, 0x16b0040098041100, 0x3900402202300400,
+0x5611032004411800, 0x3708132001014e06, 0x3d8802c040802080, 0x3790801802024210,
+0x3ea2004420210480, 0x3738400200622000, 0x3f8100228a88a005, 0x1b02004242221100,
+0x3e90040210459010, 0x5fc12020100ab606, 0x1f70501031040280, 0x6ba0080001004008,
+0x2ea10100d4104002, 0x1f1001020080a088, 0x2f90a40005010881, 0x3981110102124504,
+0x2f94244004a08300, 0x1781115080889000, 0x3fc2080202040020, 0x3f80400808048201,
+0x6340010012010040, 0x3e208b03024a008a, 0x2588122040040140, 0x41b080808d020220,
+0x178aa8541045c004, 0x3a94008824100980, 0x0f900a0090010200, 0x3d80004010400208,
+0x7580941810140601, 0x3f84011002081102, 0x66052428004d0604, 0x2f8810812a041040,
+0x3680521004200000, 0x5b80484404200208, 0x3790002208120800, 0x3ec0404104a80308,
+0x1b801090a0221100, 0x3388400224410400, 0x2ba0a06220812000, 0x3d90440088820820,
+0x6f86022118082400, 0x5ba0024c02080288, 0x3f80040842024110, 0x26c0000002104420,
+0x3f90100040104110, 0x7e00004212141508, 0x1880a060c2024040, 0x3782021014010446
+};
+
+static const uint64_t ROOK_MAGICS[64] = {
+0x2880024000221880, 0x3b80102001400484, 0x1f80082002801001, 0x1f80080110008580,
+0x7d80022400804801, 0x3e80020080014400, 0x3880408002000100, 0x2e0000802c090042,
+0x3d08800c80400024, 0x3dc2804000200080, 0x3e8a002208401080, 0x3d20040042010080,
+0x5b80800800040080, 0x3f02808012001400, 0x1f88804200010080, 0x1f01000200b04100,
+0x3780004000200040, 0x3b90004040002001, 0x6150010100402000, 0x3f88010100201000,
+0x3bc4110004080101, 0x7880808004000200, 0x1388040002880150, 0x33a026000a40a104,
+0x3fa0400080002084, 0x0e00200640045000, 0x3600200100410010, 0x0780100080080080,
+0x6f80080080800400, 0x2540020080800400, 0x7f81000100020004, 0x3fa0008200010044,
+0x2e80002000400040, 0x7c80200486804004, 0x17b0801000802001, 0x23c0801000800802,
+0x3790040080800800, 0x1e82000802001004, 0x6ec1000401000200, 0x323880a042000104,
+0x1980804000208000, 0x2f81008040050020, 0x33900080200c8010, 0x1a98018010048008,
+0x0784000800808004, 0x1382008004008002, 0x7c90010002008080, 0x7b80008100420024,
+0x1780024002200240, 0x1d80804000201880, 0x2f860020401a8200, 0x3a88220040081200,
+0x3f03020800100500, 0x3b08800200040080, 0x52a0082291100400, 0x3602004924088200,
+0x0500201100800041, 0x3f82130480400021, 0x6fc600d081292042, 0x3091041000082101,
+0x1f82000410200802, 0x3b02000815902c06, 0x77c2811090022814, 0x3f8c082408810042
+};
 
 
 // Initializes the 64x64 table, indexed by from and to square, of all
@@ -105,12 +127,7 @@ void initInBetweenTable() {
  * We use the "fancy" approach.
  * https://chessprogramming.wikispaces.com/Magic+Bitboards
  */
-void initMagicTables(uint64_t seed) {
-    // An arbitrarily chosen random number generator and seed
-    // The constant seed allows this process to be deterministic for optimization
-    // and debugging.
-    mstate = 74036198046ULL;
-    mseed = seed;
+void initMagicTables() {
     // Initialize the rook and bishop masks
     for (int i = 0; i < 64; i++) {
         // The relevant bits are everything except the edges
@@ -121,9 +138,6 @@ void initMagicTables(uint64_t seed) {
         ROOK_MASK[i] = ratt(i, 0) & relevantBits;
         BISHOP_MASK[i] = batt(i, 0) & relevantBits;
     }
-    // The attack table has 107648 entries, found by summing the 2^(# relevant bits)
-    // for all squares of both bishops and rooks
-    attackTable = new uint64_t[107648];
     // Keeps track of the start location of attack set arrays
     int runningPtrLoc = 0;
     // Initialize bishop magic values
@@ -131,7 +145,7 @@ void initMagicTables(uint64_t seed) {
         uint64_t *tableStart = attackTable;
         magicBishops[i].table = tableStart + runningPtrLoc;
         magicBishops[i].mask = BISHOP_MASK[i];
-        magicBishops[i].magic = findMagic(i, NUM_BISHOP_BITS[i], true);
+        magicBishops[i].magic = BISHOP_MAGICS[i];
         magicBishops[i].shift = 64 - NUM_BISHOP_BITS[i];
         // We need 2^n array slots for a mask of n bits
         runningPtrLoc += 1 << NUM_BISHOP_BITS[i];
@@ -141,7 +155,7 @@ void initMagicTables(uint64_t seed) {
         uint64_t *tableStart = attackTable;
         magicRooks[i].table = tableStart + runningPtrLoc;
         magicRooks[i].mask = ROOK_MASK[i];
-        magicRooks[i].magic = findMagic(i, NUM_ROOK_BITS[i], false);
+        magicRooks[i].magic = ROOK_MAGICS[i];
         magicRooks[i].shift = 64 - NUM_ROOK_BITS[i];
         runningPtrLoc += 1 << NUM_ROOK_BITS[i];
     }
@@ -159,7 +173,11 @@ void initMagicTables(uint64_t seed) {
             uint64_t attSet = batt(sq, occ);
             // Do the mapping to get the location in the attack table where we
             // store the attack set
+            #if USE_PEXT
+            int magicIndex = (int) _pext_u64(occ, mask);
+            #else
             int magicIndex = magicMap(occ, magicBishops[sq].magic, nBits);
+            #endif
             attTableLoc[magicIndex] = attSet;
         }
     }
@@ -171,7 +189,11 @@ void initMagicTables(uint64_t seed) {
             uint64_t *attTableLoc = magicRooks[sq].table;
             uint64_t occ = indexToMask64(i, nBits, mask);
             uint64_t attSet = ratt(sq, occ);
+            #if USE_PEXT
+            int magicIndex = (int) _pext_u64(occ, mask);
+            #else
             int magicIndex = magicMap(occ, magicRooks[sq].magic, nBits);
+            #endif
             attTableLoc[magicIndex] = attSet;
         }
     }
@@ -257,66 +279,3 @@ uint64_t batt(int sq, uint64_t block) {
 inline int magicMap(uint64_t masked, uint64_t magic, int nBits) {
     return (int) ((masked * magic) >> (64 - nBits));
 }
-
-/**
- * @brief Finds a magic number for the given square using trial and error.
- * @param sq The square to find the magic for.
- * @param iBits The length of the desired index, in bits
- * @param isBishop True for bishop magics, false for rook magics
- * @param magicRNG A random number generator to get magic candidates
- */
-uint64_t findMagic(int sq, int iBits, bool isBishop) {
-    uint64_t mask, maskedBits[4096], attSet[4096], used[4096], magic;
-    bool failed;
-
-    mask = isBishop ? BISHOP_MASK[sq] : ROOK_MASK[sq];
-    int nBits = count(mask);
-    // For each possible masked occupancy, get the attack set corresponding to
-    // that square and occupancy
-    for (int i = 0; i < (1 << nBits); i++) {
-        maskedBits[i] = indexToMask64(i, nBits, mask);
-        attSet[i] = isBishop ? batt(sq, maskedBits[i]) : ratt(sq, maskedBits[i]);
-    }
-    // Try 100 mill iterations before giving up
-    for (int k = 0; k < 100000000; k++) {
-        // Get a random magic candidate
-        // We make this random 64-bit integer sparse by &-ing 3 random numbers
-        // Sparse numbers are beneficial to keep the multiplied bits from
-        // bleeding together and becoming garbage
-        magic = magicRNG() & magicRNG() & magicRNG();
-        // We want a large number of high bits to get a higher success rate,
-        // since mask * magic is shifted by 64 - n bits, leaving n bits at the
-        // end. Thus, anything but the top 12 bits (for rooks in the corners) or
-        // less (for bishops) is garbage. Having a large number of high bits
-        // when multiplying by the full mask gives a better spread of values
-        // with different partial masks.
-        if (count((mask * magic) & 0xFFF0000000000000ULL) < 10)
-            continue;
-
-        // Clear the used table
-        for (int i = 0; i < 4096; i++)
-            used[i] = 0;
-        // Calculate the packed bits for every possible mask using this magic
-        // and see if any fail
-        failed = false;
-        for (int i = 0; !failed && i < (1 << nBits); i++) {
-            int mappedIndex = magicMap(maskedBits[i], magic, iBits);
-            // No collision, mark the index as used for the given attack set
-            if (!used[mappedIndex])
-                used[mappedIndex] = attSet[i];
-            // Otherwise, check for a constructive collsion, where a different
-            // occupancy has the same attack set.
-            // If the collision is not constructive, then we failed.
-            else if (used[mappedIndex] != attSet[i])
-                failed = true;
-        }
-        // If there were no collisions in all 2^nBits mappings, we have found
-        // a valid magic
-        if (!failed)
-            return magic;
-    }
-
-    // Otherwise we failed :(
-    // (this should never happen)
-    return 0;
-}
@@ -155,7 +155,7 @@ struct MagicInfo {
     int shift;
 };
 
-void initMagicTables(uint64_t seed);
+void initMagicTables();
 void initInBetweenTable();
 
 #endif
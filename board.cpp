@@ -23,7 +23,11 @@
 #include "board.h"
 #include "bbinit.h"
 #include "eval.h"
+#include "profile.h"
 #include "uci.h"
+#if USE_PEXT
+#include <immintrin.h>
+#endif
 
 
 const uint64_t WHITE_KSIDE_PASSTHROUGH_SQS = INDEX_TO_BIT[5] | INDEX_TO_BIT[6];
@@ -31,9 +35,14 @@ const uint64_t WHITE_QSIDE_PASSTHROUGH_SQS = INDEX_TO_BIT[1] | INDEX_TO_BIT[2] |
 const uint64_t BLACK_KSIDE_PASSTHROUGH_SQS = INDEX_TO_BIT[61] | INDEX_TO_BIT[62];
 const uint64_t BLACK_QSIDE_PASSTHROUGH_SQS = INDEX_TO_BIT[57] | INDEX_TO_BIT[58] | INDEX_TO_BIT[59];
 
-// Zobrist hashing table and the start position key, both initialized at startup
+// Zobrist hashing table and the start position keys, all initialized at startup
 uint64_t zobristTable[794];
 static uint64_t startPosZobristKey = 0;
+static uint64_t startPosPawnZobristKey = 0;
+// Incremental eval terms for the start position, also initialized at startup
+static Score startPosPsqtScores[2];
+static int startPosMaterial[2][2];
+static int8_t startPosPieceCounts[2][6];
 
 void initZobristTable() {
     std::mt19937_64 rng (61280152908);
@@ -44,11 +53,20 @@ void initZobristTable() {
     int *mailbox = b.getMailbox();
     b.initZobristKey(mailbox);
     startPosZobristKey = b.getZobristKey();
+    startPosPawnZobristKey = b.getPawnZobristKey();
+    // The PSQT must be initialized before this point
+    b.initEvalTerms();
+    for (int color = WHITE; color <= BLACK; color++) {
+        startPosPsqtScores[color] = b.getPsqtScore(color);
+        startPosMaterial[MG][color] = b.getMaterial(MG, color);
+        startPosMaterial[EG][color] = b.getMaterial(EG, color);
+        for (int pieceID = PAWNS; pieceID <= KINGS; pieceID++)
+            startPosPieceCounts[color][pieceID] = b.getPieceCount(color, pieceID);
+    }
     delete[] mailbox;
 }
 
 // Magic tables, initialized in bbinit.cpp
-extern uint64_t *attackTable;
 extern MagicInfo magicBishops[64];
 extern MagicInfo magicRooks[64];
 
@@ -77,11 +95,15 @@ Board::Board() {
     pieces[BLACK][KINGS] = 0x1000000000000000; // black kings
 
     zobristKey = startPosZobristKey;
+    pawnZobristKey = startPosPawnZobristKey;
     epCaptureFile = NO_EP_POSSIBLE;
     playerToMove = WHITE;
     moveNumber = 1;
     castlingRights = WHITECASTLE | BLACKCASTLE;
     fiftyMoveCounter = 0;
+    std::memcpy(psqtScores, startPosPsqtScores, sizeof(psqtScores));
+    std::memcpy(material, startPosMaterial, sizeof(material));
+    std::memcpy(pieceCounts, startPosPieceCounts, sizeof(pieceCounts));
 }
 
 // Create a board object from a mailbox of the current board state.
@@ -118,6 +140,7 @@ Board::Board(int *mailboxBoard, bool _whiteCanKCastle, bool _blackCanKCastle,
         castlingRights |= BLACKQSIDE;
     fiftyMoveCounter = _fiftyMoveCounter;
     initZobristKey(mailboxBoard);
+    initEvalTerms();
 }
 
 Board::~Board() {}
@@ -132,6 +155,26 @@ Board Board::staticCopy() {
 //------------------------------------------------------------------------------
 //---------------------------------Do Move--------------------------------------
 //------------------------------------------------------------------------------
+// Keep the incremental material, PSQT, and piece count terms in sync when a
+// piece is added, removed, or moved. Kings are only ever moved.
+inline void Board::addEvalTerms(int color, int pieceID, int sq) {
+    psqtScores[color] += PSQT[color][pieceID][sq];
+    material[MG][color] += PIECE_VALUES[MG][pieceID];
+    material[EG][color] += PIECE_VALUES[EG][pieceID];
+    pieceCounts[color][pieceID]++;
+}
+
+inline void Board::removeEvalTerms(int color, int pieceID, int sq) {
+    psqtScores[color] -= PSQT[color][pieceID][sq];
+    material[MG][color] -= PIECE_VALUES[MG][pieceID];
+    material[EG][color] -= PIECE_VALUES[EG][pieceID];
+    pieceCounts[color][pieceID]--;
+}
+
+inline void Board::moveEvalTerms(int color, int pieceID, int startSq, int endSq) {
+    psqtScores[color] += PSQT[color][pieceID][endSq] - PSQT[color][pieceID][startSq];
+}
+
 /**
  * @brief Updates the board and Zobrist keys with Move m.
  */
@@ -160,6 +203,11 @@ void Board::doMove(Move m, int color) {
             zobristKey ^= zobristTable[384*color + startSq];
             zobristKey ^= zobristTable[384*color + 64*promotionType + endSq];
             zobristKey ^= zobristTable[384*(color^1) + 64*captureType + endSq];
+            pawnZobristKey ^= zobristTable[384*color + startSq];
+
+            removeEvalTerms(color, PAWNS, startSq);
+            addEvalTerms(color, promotionType, endSq);
+            removeEvalTerms(color^1, captureType, endSq);
         }
         else {
             pieces[color][PAWNS] &= ~INDEX_TO_BIT[startSq];
@@ -170,6 +218,10 @@ void Board::doMove(Move m, int color) {
 
             zobristKey ^= zobristTable[384*color + startSq];
             zobristKey ^= zobristTable[384*color + 64*promotionType + endSq];
+            pawnZobristKey ^= zobristTable[384*color + startSq];
+
+            removeEvalTerms(color, PAWNS, startSq);
+            addEvalTerms(color, promotionType, endSq);
         }
         epCaptureFile = NO_EP_POSSIBLE;
         fiftyMoveCounter = 0;
@@ -189,6 +241,12 @@ void Board::doMove(Move m, int color) {
             zobristKey ^= zobristTable[384*color + startSq];
             zobristKey ^= zobristTable[384*color + endSq];
             zobristKey ^= zobristTable[384*(color^1) + capSq];
+            pawnZobristKey ^= zobristTable[384*color + startSq];
+            pawnZobristKey ^= zobristTable[384*color + endSq];
+            pawnZobristKey ^= zobristTable[384*(color^1) + capSq];
+
+            moveEvalTerms(color, PAWNS, startSq, endSq);
+            removeEvalTerms(color^1, PAWNS, capSq);
         }
         else {
             int captureType = getPieceOnSquare(color^1, endSq);
@@ -203,6 +261,15 @@ void Board::doMove(Move m, int color) {
             zobristKey ^= zobristTable[384*color + 64*pieceID + startSq];
             zobristKey ^= zobristTable[384*color + 64*pieceID + endSq];
             zobristKey ^= zobristTable[384*(color^1) + 64*captureType + endSq];
+            if (pieceID == PAWNS) {
+                pawnZobristKey ^= zobristTable[384*color + startSq];
+                pawnZobristKey ^= zobristTable[384*color + endSq];
+            }
+            if (captureType == PAWNS)
+                pawnZobristKey ^= zobristTable[384*(color^1) + endSq];
+
+            moveEvalTerms(color, pieceID, startSq, endSq);
+            removeEvalTerms(color^1, captureType, endSq);
         }
         epCaptureFile = NO_EP_POSSIBLE;
         fiftyMoveCounter = 0;
@@ -224,6 +291,9 @@ void Board::doMove(Move m, int color) {
                 zobristKey ^= zobristTable[64*KINGS+6];
                 zobristKey ^= zobristTable[64*ROOKS+7];
                 zobristKey ^= zobristTable[64*ROOKS+5];
+
+                moveEvalTerms(WHITE, KINGS, 4, 6);
+                moveEvalTerms(WHITE, ROOKS, 7, 5);
             }
             else if (endSq == 2) { // white qside
                 pieces[WHITE][KINGS] &= ~INDEX_TO_BIT[4];
@@ -240,6 +310,9 @@ void Board::doMove(Move m, int color) {
                 zobristKey ^= zobristTable[64*KINGS+2];
                 zobristKey ^= zobristTable[64*ROOKS+0];
                 zobristKey ^= zobristTable[64*ROOKS+3];
+
+                moveEvalTerms(WHITE, KINGS, 4, 2);
+                moveEvalTerms(WHITE, ROOKS, 0, 3);
             }
             else if (endSq == 62) { // black kside
                 pieces[BLACK][KINGS] &= ~INDEX_TO_BIT[60];
@@ -256,6 +329,9 @@ void Board::doMove(Move m, int color) {
                 zobristKey ^= zobristTable[384+64*KINGS+62];
                 zobristKey ^= zobristTable[384+64*ROOKS+63];
                 zobristKey ^= zobristTable[384+64*ROOKS+61];
+
+                moveEvalTerms(BLACK, KINGS, 60, 62);
+                moveEvalTerms(BLACK, ROOKS, 63, 61);
             }
             else { // black qside
                 pieces[BLACK][KINGS] &= ~INDEX_TO_BIT[60];
@@ -272,6 +348,9 @@ void Board::doMove(Move m, int color) {
                 zobristKey ^= zobristTable[384+64*KINGS+58];
                 zobristKey ^= zobristTable[384+64*ROOKS+56];
                 zobristKey ^= zobristTable[384+64*ROOKS+59];
+
+                moveEvalTerms(BLACK, KINGS, 60, 58);
+                moveEvalTerms(BLACK, ROOKS, 56, 59);
             }
             epCaptureFile = NO_EP_POSSIBLE;
             fiftyMoveCounter++;
@@ -286,8 +365,12 @@ void Board::doMove(Move m, int color) {
             zobristKey ^= zobristTable[384*color + 64*pieceID + startSq];
             zobristKey ^= zobristTable[384*color + 64*pieceID + endSq];
 
+            moveEvalTerms(color, pieceID, startSq, endSq);
+
             // check for en passant
             if (pieceID == PAWNS) {
+                pawnZobristKey ^= zobristTable[384*color + startSq];
+                pawnZobristKey ^= zobristTable[384*color + endSq];
                 if (getFlags(m) == MOVE_DOUBLE_PAWN)
                     epCaptureFile = startSq & 7;
                 else
@@ -343,8 +426,90 @@ bool Board::doPseudoLegalMove(Move m, int color) {
     return !(isInCheck(color));
 }
 
+// Makes Move m, saving what is needed to take it back with undoMove()
+void Board::doMove(Move m, int color, UndoInfo &undo) {
+    undo.zobristKey = zobristKey;
+    undo.pawnZobristKey = pawnZobristKey;
+    undo.capturedPiece = (isCapture(m) && !isEP(m))
+                       ? (int8_t) getPieceOnSquare(color^1, getEndSq(m)) : -1;
+    undo.castlingRights = castlingRights;
+    undo.fiftyMoveCounter = fiftyMoveCounter;
+    undo.epCaptureFile = epCaptureFile;
+    doMove(m, color);
+}
+
+bool Board::doPseudoLegalMove(Move m, int color, UndoInfo &undo) {
+    doMove(m, color, undo);
+    return !(isInCheck(color));
+}
+
+/**
+ * @brief Takes back Move m, which color made with doMove(m, color, undo).
+ * Piece positions and the incremental eval terms are updated in reverse;
+ * the keys and flags are restored from the undo record.
+ */
+void Board::undoMove(Move m, int color, const UndoInfo &undo) {
+    int startSq = getStartSq(m);
+    int endSq = getEndSq(m);
+    uint64_t moveBits = INDEX_TO_BIT[startSq] | INDEX_TO_BIT[endSq];
+
+    if (isPromotion(m)) {
+        int promotionType = getPromotion(m);
+        pieces[color][promotionType] &= ~INDEX_TO_BIT[endSq];
+        pieces[color][PAWNS] |= INDEX_TO_BIT[startSq];
+        allPieces[color] ^= moveBits;
+
+        removeEvalTerms(color, promotionType, endSq);
+        addEvalTerms(color, PAWNS, startSq);
+    }
+    else if (isCastle(m)) {
+        // The rook's squares, from the king's end square
+        int rookStart = (endSq & 7) == 6 ? endSq + 1 : endSq - 2;
+        int rookEnd = (endSq & 7) == 6 ? endSq - 1 : endSq + 1;
+        uint64_t rookBits = INDEX_TO_BIT[rookStart] | INDEX_TO_BIT[rookEnd];
+        pieces[color][KINGS] ^= moveBits;
+        pieces[color][ROOKS] ^= rookBits;
+        allPieces[color] ^= moveBits | rookBits;
+
+        moveEvalTerms(color, KINGS, endSq, startSq);
+        moveEvalTerms(color, ROOKS, rookEnd, rookStart);
+    }
+    else {
+        int pieceID = getPieceOnSquare(color, endSq);
+        pieces[color][pieceID] ^= moveBits;
+        allPieces[color] ^= moveBits;
+
+        moveEvalTerms(color, pieceID, endSq, startSq);
+    }
+
+    // Put back any captured piece
+    if (isEP(m)) {
+        int capSq = epVictimSquare(color^1, undo.epCaptureFile);
+        pieces[color^1][PAWNS] |= INDEX_TO_BIT[capSq];
+        allPieces[color^1] |= INDEX_TO_BIT[capSq];
+        addEvalTerms(color^1, PAWNS, capSq);
+    }
+    else if (undo.capturedPiece != -1) {
+        pieces[color^1][undo.capturedPiece] |= INDEX_TO_BIT[endSq];
+        allPieces[color^1] |= INDEX_TO_BIT[endSq];
+        addEvalTerms(color^1, undo.capturedPiece, endSq);
+    }
+
+    zobristKey = undo.zobristKey;
+    pawnZobristKey = undo.pawnZobristKey;
+    castlingRights = undo.castlingRights;
+    fiftyMoveCounter = undo.fiftyMoveCounter;
+    epCaptureFile = undo.epCaptureFile;
+
+    if (color == BLACK)
+        moveNumber--;
+    playerToMove = color;
+}
+
 // Do a hash move, which requires a few more checks in case of a Type-1 error.
-bool Board::doHashMove(Move m, int color) {
+// The move is recorded in undo for undoMove(). If the move is rejected, the
+// board is left unchanged.
+bool Board::doHashMove(Move m, int color, UndoInfo &undo) {
     int pieceID = getPieceOnSquare(color, getStartSq(m));
     // Check that the start square is not empty
     if (pieceID == -1)
@@ -362,7 +527,75 @@ bool Board::doHashMove(Move m, int color) {
     if (isCapture(m) && ((endSingle & pieces[WHITE][KINGS]) || (endSingle & pieces[BLACK][KINGS])))
         return false;
 
-    return doPseudoLegalMove(m, color);
+    if (!doPseudoLegalMove(m, color, undo)) {
+        undoMove(m, color, undo);
+        return false;
+    }
+    return true;
+}
+
+// Checks whether a quiet move taken from another position, such as a killer,
+// would be generated by getPseudoLegalQuiets in this position.
+bool Board::isPseudoLegalQuiet(Move m, int color) {
+    if (m == NULL_MOVE || isCapture(m))
+        return false;
+
+    int startSq = getStartSq(m);
+    uint64_t endSingle = INDEX_TO_BIT[getEndSq(m)];
+    uint64_t occ = getOccupancy();
+    if (endSingle & occ)
+        return false;
+
+    if (isCastle(m)) {
+        MoveList castles;
+        addCastlesToList(castles, color);
+        for (unsigned int i = 0; i < castles.size(); i++) {
+            if (castles.get(i) == m)
+                return true;
+        }
+        return false;
+    }
+
+    int pieceID = getPieceOnSquare(color, startSq);
+    if (pieceID == -1)
+        return false;
+
+    if (pieceID == PAWNS) {
+        uint64_t pawn = INDEX_TO_BIT[startSq];
+        if (getFlags(m) == MOVE_DOUBLE_PAWN) {
+            return endSingle & ((color == WHITE) ? getWPawnDoubleMoves(pawn)
+                                                 : getBPawnDoubleMoves(pawn));
+        }
+        if (!(endSingle & ((color == WHITE) ? getWPawnSingleMoves(pawn)
+                                            : getBPawnSingleMoves(pawn))))
+            return false;
+        // Pushes are promotions exactly when they reach the final rank
+        uint64_t finalRank = (color == WHITE) ? RANK_8 : RANK_1;
+        return isPromotion(m) == ((endSingle & finalRank) != 0);
+    }
+
+    if (getFlags(m) != 0)
+        return false;
+
+    uint64_t endSqs = 0;
+    switch (pieceID) {
+        case KNIGHTS:
+            endSqs = getKnightSquares(startSq);
+            break;
+        case BISHOPS:
+            endSqs = getBishopSquares(startSq, occ);
+            break;
+        case ROOKS:
+            endSqs = getRookSquares(startSq, occ);
+            break;
+        case QUEENS:
+            endSqs = getQueenSquares(startSq, occ);
+            break;
+        case KINGS:
+            endSqs = getKingSquares(startSq);
+            break;
+    }
+    return (endSqs & endSingle) != 0;
 }
 
 // Handle null moves for null move pruning by switching the player to move.
@@ -382,6 +615,62 @@ void Board::undoNullMove(uint16_t _epCaptureFile) {
     zobristKey ^= zobristTable[785 + epCaptureFile];
 }
 
+// Returns the castling rights lost when a piece moves from or to sq
+inline uint8_t castlingRightsLost(int sq) {
+    switch (sq) {
+        case 0:  return WHITEQSIDE;
+        case 4:  return WHITECASTLE;
+        case 7:  return WHITEKSIDE;
+        case 56: return BLACKQSIDE;
+        case 60: return BLACKCASTLE;
+        case 63: return BLACKKSIDE;
+        default: return 0;
+    }
+}
+
+/**
+ * @brief Predicts the Zobrist key after Move m without making the move, so that
+ * hash table entries for the child position can be prefetched early.
+ * Castling rights are updated by square, which matches doMove() for all
+ * positions that can arise in a game.
+ */
+uint64_t Board::getZobristKeyAfterMove(Move m, int color) {
+    int startSq = getStartSq(m);
+    int endSq = getEndSq(m);
+    uint64_t key = zobristKey ^ zobristTable[768];
+
+    if (isCastle(m)) {
+        int rookStart = (endSq > startSq) ? startSq + 3 : startSq - 4;
+        int rookEnd = (endSq > startSq) ? startSq + 1 : startSq - 1;
+        key ^= zobristTable[384*color + 64*KINGS + startSq];
+        key ^= zobristTable[384*color + 64*KINGS + endSq];
+        key ^= zobristTable[384*color + 64*ROOKS + rookStart];
+        key ^= zobristTable[384*color + 64*ROOKS + rookEnd];
+    }
+    else {
+        int pieceID = getPieceOnSquare(color, startSq);
+        int endPieceID = isPromotion(m) ? getPromotion(m) : pieceID;
+        key ^= zobristTable[384*color + 64*pieceID + startSq];
+        key ^= zobristTable[384*color + 64*endPieceID + endSq];
+
+        if (isEP(m))
+            key ^= zobristTable[384*(color^1) + epVictimSquare(color^1, epCaptureFile)];
+        else if (isCapture(m))
+            key ^= zobristTable[384*(color^1) + 64*getPieceOnSquare(color^1, endSq) + endSq];
+    }
+
+    uint16_t newEPCaptureFile = (getFlags(m) == MOVE_DOUBLE_PAWN) ? (startSq & 7) : NO_EP_POSSIBLE;
+    key ^= zobristTable[785 + epCaptureFile];
+    key ^= zobristTable[785 + newEPCaptureFile];
+
+    uint8_t newCastlingRights = castlingRights
+        & ~(castlingRightsLost(startSq) | castlingRightsLost(endSq));
+    key ^= zobristTable[769 + castlingRights];
+    key ^= zobristTable[769 + newCastlingRights];
+
+    return key;
+}
+
 
 //------------------------------------------------------------------------------
 //-------------------------------Move Generation--------------------------------
@@ -437,24 +726,76 @@ PieceMoveList Board::getPieceMoveList(int color) {
     return pml;
 }
 
-// Get all legal moves and captures
+// Get all legal moves and captures, in the same order as the pseudo-legal
+// move generator
 MoveList Board::getAllLegalMoves(int color) {
     MoveList moves;
     getAllPseudoLegalMoves(moves, color);
+    LegalityInfo info = getLegalityInfo(color);
 
+    // Compact the legal moves to the front of the list
+    unsigned int legalCount = 0;
     for (unsigned int i = 0; i < moves.size(); i++) {
-        Board b = staticCopy();
-        b.doMove(moves.get(i), color);
-
-        if (b.isInCheck(color)) {
-            moves.remove(i);
-            i--;
-        }
+        if (isLegalMove(moves.get(i), color, info))
+            moves.set(legalCount++, moves.get(i));
     }
+    moves.resize(legalCount);
 
     return moves;
 }
 
+LegalityInfo Board::getLegalityInfo(int color) {
+    LegalityInfo info;
+    info.kingSq = bitScanForward(pieces[color][KINGS]);
+    info.pinned = getPinnedMap(color);
+
+    uint64_t checkers = getAttackMap(color^1, info.kingSq);
+    if (checkers == 0)
+        info.checkMask = ~0ULL;
+    else if (count(checkers) == 1)
+        info.checkMask = checkers | inBetweenSqs[info.kingSq][bitScanForward(checkers)];
+    else
+        info.checkMask = 0;
+
+    return info;
+}
+
+/**
+ * @brief Returns whether a pseudo-legal move leaves the king safe.
+ * King moves must not end on an attacked square. Other moves must end on the
+ * check mask, and pinned pieces can only move along the line through the king.
+ * En passant can uncover a check along the rank, so it is tested by making
+ * the move.
+ */
+bool Board::isLegalMove(Move m, int color, const LegalityInfo &info) {
+    int startSq = getStartSq(m);
+    int endSq = getEndSq(m);
+
+    if (startSq == info.kingSq) {
+        // Castles are only generated when the king is not in check and does
+        // not pass through an attacked square
+        if (isCastle(m))
+            return getAttackMap(color^1, endSq) == 0;
+        // The king cannot block an attack on its own end square
+        return getAttackMap(color^1, endSq, getOccupancy() ^ INDEX_TO_BIT[startSq]) == 0;
+    }
+
+    if (isEP(m)) {
+        UndoInfo undo;
+        bool isLegal = doPseudoLegalMove(m, color, undo);
+        undoMove(m, color, undo);
+        return isLegal;
+    }
+
+    if (!(INDEX_TO_BIT[endSq] & info.checkMask))
+        return false;
+    // A pinned piece stays on the line through the king if it moves towards
+    // the king or away from it
+    return !(INDEX_TO_BIT[startSq] & info.pinned)
+        || (inBetweenSqs[info.kingSq][endSq] & INDEX_TO_BIT[startSq])
+        || (inBetweenSqs[info.kingSq][startSq] & INDEX_TO_BIT[endSq]);
+}
+
 //------------------------------Pseudo-legal Moves------------------------------
 /* Pseudo-legal moves disregard whether the player's king is left in check
  * The pseudo-legal move and capture generators all follow a similar scheme:
@@ -478,6 +819,7 @@ void Board::getAllPseudoLegalMoves(MoveList &legalMoves, int color) {
  * King moves
  */
 void Board::getPseudoLegalQuiets(MoveList &quiets, int color) {
+    PROFILE_SCOPE(PROFILE_MOVEGEN);
     addCastlesToList(quiets, color);
 
     addPieceMovesToList<MOVEGEN_QUIETS>(quiets, color);
@@ -500,6 +842,7 @@ void Board::getPseudoLegalQuiets(MoveList &quiets, int color) {
  * Queen captures
  */
 void Board::getPseudoLegalCaptures(MoveList &captures, int color, bool includePromotions) {
+    PROFILE_SCOPE(PROFILE_MOVEGEN);
     uint64_t otherPieces = allPieces[color^1];
 
     int kingStSq = bitScanForward(pieces[color][KINGS]);
@@ -513,6 +856,7 @@ void Board::getPseudoLegalCaptures(MoveList &captures, int color, bool includePr
 
 // Generates all queen promotions for quiescence search
 void Board::getPseudoLegalPromotions(MoveList &moves, int color) {
+    PROFILE_SCOPE(PROFILE_MOVEGEN);
     uint64_t otherPieces = allPieces[color^1];
 
     uint64_t pawns = pieces[color][PAWNS];
@@ -578,6 +922,7 @@ void Board::getPseudoLegalPromotions(MoveList &moves, int color) {
  * For simplicity, promotions and en passant are left out of this function.
  */
 void Board::getPseudoLegalChecks(MoveList &checks, int color) {
+    PROFILE_SCOPE(PROFILE_MOVEGEN);
     int kingSq = bitScanForward(pieces[color^1][KINGS]);
     // Square parity for knight and bishop moves
     uint64_t kingParity = (pieces[color^1][KINGS] & LIGHT) ? LIGHT : DARK;
@@ -702,6 +1047,7 @@ void Board::getPseudoLegalChecks(MoveList &checks, int color) {
 // Optimizations include looking for double check (king moves only),
 // otherwise we can only capture the checker or block if it is an xray piece
 void Board::getPseudoLegalCheckEscapes(MoveList &escapes, int color) {
+    PROFILE_SCOPE(PROFILE_MOVEGEN);
     int kingSq = bitScanForward(pieces[color][KINGS]);
     uint64_t otherPieces = allPieces[color^1];
     uint64_t attackMap = getAttackMap(color^1, kingSq);
@@ -1058,7 +1404,12 @@ uint64_t Board::getXRayPieceMap(int color, int sq, int blockerColor,
 // Given a color and a square, returns all pieces of the color that attack the
 // square. Useful for checks, captures
 uint64_t Board::getAttackMap(int color, int sq) {
-    uint64_t occ = getOccupancy();
+    return getAttackMap(color, sq, getOccupancy());
+}
+
+// Get all pieces of that color attacking the square, with the given occupancy
+// for slider attacks
+uint64_t Board::getAttackMap(int color, int sq, uint64_t occ) {
     uint64_t pawnCap = (color == WHITE)
                      ? getBPawnCaptures(INDEX_TO_BIT[sq])
                      : getWPawnCaptures(INDEX_TO_BIT[sq]);
@@ -1096,48 +1447,63 @@ int Board::getPieceOnSquare(int color, int sq) {
 // Returns true if a move puts the opponent in check
 // Precondition: opposing king is not already in check (obviously)
 // Does not consider en passant or castling
-bool Board::isCheckMove(int color, Move m) {
-    int kingSq = bitScanForward(pieces[color^1][KINGS]);
-
-    // See if move is a direct check
-    uint64_t attackMap = 0;
+CheckInfo Board::getCheckInfo(int color) {
+    CheckInfo info;
+    info.kingSq = bitScanForward(pieces[color^1][KINGS]);
     uint64_t occ = getOccupancy();
-    switch (getPieceOnSquare(color, getStartSq(m))) {
-        case PAWNS:
-            attackMap = (color == WHITE)
-                ? getBPawnCaptures(INDEX_TO_BIT[kingSq])
-                : getWPawnCaptures(INDEX_TO_BIT[kingSq]);
-            break;
-        case KNIGHTS:
-            attackMap = getKnightSquares(kingSq);
-            break;
-        case BISHOPS:
-            attackMap = getBishopSquares(kingSq, occ);
-            break;
-        case ROOKS:
-            attackMap = getRookSquares(kingSq, occ);
-            break;
-        case QUEENS:
-            attackMap = getQueenSquares(kingSq, occ);
-            break;
-        case KINGS:
-            // keep attackMap 0
-            break;
+
+    info.checkSqs[PAWNS] = (color == WHITE)
+        ? getBPawnCaptures(INDEX_TO_BIT[info.kingSq])
+        : getWPawnCaptures(INDEX_TO_BIT[info.kingSq]);
+    info.checkSqs[KNIGHTS] = getKnightSquares(info.kingSq);
+    info.checkSqs[BISHOPS] = getBishopSquares(info.kingSq, occ);
+    info.checkSqs[ROOKS] = getRookSquares(info.kingSq, occ);
+    info.checkSqs[QUEENS] = info.checkSqs[BISHOPS] | info.checkSqs[ROOKS];
+    info.checkSqs[KINGS] = 0;
+
+    // Our sliders x-raying the king through exactly one of our pieces
+    uint64_t blockers = allPieces[color];
+    info.discoverers = 0;
+    uint64_t sliders = (getRookXRays(info.kingSq, occ, blockers)
+                        & (pieces[color][ROOKS] | pieces[color][QUEENS]))
+                     | (getBishopXRays(info.kingSq, occ, blockers)
+                        & (pieces[color][BISHOPS] | pieces[color][QUEENS]));
+    while (sliders) {
+        int sq = bitScanForward(sliders);
+        info.discoverers |= inBetweenSqs[sq][info.kingSq] & blockers;
+        sliders &= sliders - 1;
     }
-    if (INDEX_TO_BIT[getEndSq(m)] & attackMap)
-        return true;
 
-    // See if move is a discovered check
-    // Get a bitboard of all pieces that could possibly xray
-    uint64_t xrayPieces = pieces[color][BISHOPS] | pieces[color][ROOKS] | pieces[color][QUEENS];
+    return info;
+}
+
+bool Board::isCheckMove(int color, Move m) {
+    return isCheckMove(color, m, getCheckInfo(color));
+}
+
+// Checks whether a move gives direct or discovered check, using the squares
+// precomputed for the position. Promotions are treated as pawn moves.
+bool Board::isCheckMove(int color, Move m, const CheckInfo &info) {
+    int startSq = getStartSq(m);
+    uint64_t endSingle = INDEX_TO_BIT[getEndSq(m)];
 
-    // Get any bishops, rooks, queens attacking king after piece has moved
-    uint64_t xrays = getXRayPieceMap(color, kingSq, color, INDEX_TO_BIT[getStartSq(m)], INDEX_TO_BIT[getEndSq(m)]);
-    // If there is an xray piece attacking the king square after the piece has
-    // moved, we have discovered check
-    if (xrays & xrayPieces)
+    // See if move is a direct check
+    if (info.checkSqs[getPieceOnSquare(color, startSq)] & endSingle)
         return true;
 
+    // See if move is a discovered check, which is only possible if the piece
+    // was blocking one of our sliders. The move may stay on the line, so the
+    // attacks are recomputed with the piece moved.
+    if (info.discoverers & INDEX_TO_BIT[startSq]) {
+        uint64_t occ = (getOccupancy() ^ INDEX_TO_BIT[startSq]) | endSingle;
+        uint64_t xrays = (getBishopSquares(info.kingSq, occ)
+                          & (pieces[color][BISHOPS] | pieces[color][QUEENS]))
+                       | (getRookSquares(info.kingSq, occ)
+                          & (pieces[color][ROOKS] | pieces[color][QUEENS]));
+        if (xrays & ~INDEX_TO_BIT[startSq])
+            return true;
+    }
+
     // If not direct or discovered check, then not a check
     return false;
 }
@@ -1232,11 +1598,16 @@ void Board::getCheckMaps(int color, uint64_t *checkMaps) {
 //------------------------------------------------------------------------------
 //--------------------------------Move Ordering---------------------------------
 //------------------------------------------------------------------------------
-int Board::getMaterial(int color) {
-    int material = 0;
-    for (int pieceID = PAWNS; pieceID <= QUEENS; pieceID++)
-        material += PIECE_VALUES[MG][pieceID] * count(pieces[color][pieceID]);
-    return material;
+int Board::getMaterial(int phase, int color) {
+    return material[phase][color];
+}
+
+int Board::getPieceCount(int color, int pieceID) {
+    return pieceCounts[color][pieceID];
+}
+
+Score Board::getPsqtScore(int color) {
+    return psqtScores[color];
 }
 
 uint64_t Board::getNonPawnMaterial(int color) {
@@ -1260,6 +1631,7 @@ uint64_t Board::getLeastValuableAttacker(uint64_t attackers, int color, int &pie
 // Static exchange evaluation algorithm from
 // https://chessprogramming.wikispaces.com/SEE+-+The+Swap+Algorithm
 int Board::getSEE(int color, int sq) {
+    PROFILE_SCOPE(PROFILE_SEE);
     int gain[32], d = 0, piece = 0;
     uint64_t attackers = getAttackMap(sq);
     // used attackers that may act as blockers for x-ray pieces
@@ -1297,6 +1669,7 @@ int Board::getSEE(int color, int sq) {
  * forcing the initial move (to avoid standing pat if the move is bad).
  */
 int Board::getSEEForMove(int color, Move m) {
+    PROFILE_SCOPE(PROFILE_SEE);
     int value = 0;
     int startSq = getStartSq(m);
     int endSq = getEndSq(m);
@@ -1336,6 +1709,120 @@ int Board::getSEEForMove(int color, Move m) {
     return value;
 }
 
+/**
+ * @brief Returns whether the exchange started by move m wins at least threshold
+ * for color, using the swap algorithm with a forced first recapture: the
+ * opponent must recapture if it can, and after that either side may stop
+ * capturing. It stops as soon as the result is decided instead of computing
+ * the full exchange. If earlyExit is given, it is set to whether the result
+ * was decided with attackers left on the square.
+ *
+ * This is not a threshold test of getSEEForMove. That function prunes the
+ * swap list with getSEE's stand pat rule and scores en passant captures as 0,
+ * while this one does an exact swap and scores en passant as winning a pawn.
+ * The two can disagree, so one should not be swapped for the other.
+ *
+ * The attackers are computed here rather than taken from the per-node
+ * LegalityInfo or CheckInfo. Those describe the king's lines, but the exchange
+ * needs every attacker of the target square with the moving piece already
+ * removed. Deriving that set from attack data for the node's occupancy would
+ * take the same two slider lookups for the x-rays through the start square.
+ * It also exits before any lookup when the first capture already decides the
+ * result.
+ */
+bool Board::getSEEGreaterEqual(int color, Move m, int threshold, bool *earlyExit) {
+    PROFILE_SCOPE(PROFILE_SEE);
+    int startSq = getStartSq(m);
+    int sq = getEndSq(m);
+    // The material balance relative to the threshold, and the value of the
+    // piece that the next capture would win. An en passant capture wins
+    // exactly a pawn.
+    int balance = (isEP(m) ? SEE_PIECE_VALS[PAWNS]
+                 : isCapture(m) ? SEE_PIECE_VALS[getPieceOnSquare(color^1, sq)] : 0)
+                - threshold;
+    int onSquare = SEE_PIECE_VALS[getPieceOnSquare(color, startSq)];
+
+    // Even if the moved piece is lost, we can stand pat afterwards
+    if (balance - onSquare >= 0) {
+        if (earlyExit != nullptr)
+            *earlyExit = true;
+        return true;
+    }
+
+    uint64_t occ = getOccupancy() ^ INDEX_TO_BIT[startSq];
+    if (isEP(m))
+        occ ^= INDEX_TO_BIT[epVictimSquare(color^1, epCaptureFile)];
+    uint64_t diagonals = pieces[WHITE][BISHOPS] | pieces[WHITE][QUEENS]
+                       | pieces[BLACK][BISHOPS] | pieces[BLACK][QUEENS];
+    uint64_t straights = pieces[WHITE][ROOKS] | pieces[WHITE][QUEENS]
+                       | pieces[BLACK][ROOKS] | pieces[BLACK][QUEENS];
+    uint64_t sqBit = INDEX_TO_BIT[sq];
+    uint64_t attackers = ((getBPawnCaptures(sqBit) & pieces[WHITE][PAWNS])
+                        | (getWPawnCaptures(sqBit) & pieces[BLACK][PAWNS])
+                        | (getKnightSquares(sq) & (pieces[WHITE][KNIGHTS] | pieces[BLACK][KNIGHTS]))
+                        | (getBishopSquares(sq, occ) & diagonals)
+                        | (getRookSquares(sq, occ) & straights)
+                        | (getKingSquares(sq) & (pieces[WHITE][KINGS] | pieces[BLACK][KINGS])))
+                       & occ;
+
+    int side = color ^ 1;
+    bool isFirstRecapture = true;
+    bool exhausted = false;
+    bool result;
+    while (true) {
+        // Either side can stand pat with a result in its favor, except that
+        // the first recapture is forced
+        if (side == color && balance >= 0) {
+            result = true;
+            break;
+        }
+        if (side != color && !isFirstRecapture && balance < 0) {
+            result = false;
+            break;
+        }
+
+        int piece;
+        uint64_t single = getLeastValuableAttacker(attackers & allPieces[side], side, piece);
+        if (!single) {
+            result = (balance >= 0);
+            exhausted = true;
+            break;
+        }
+
+        // After a capture, the other side can stand pat, so the result can
+        // be no better for the capturing side than the balance after it
+        if (side == color) {
+            balance += onSquare;
+            if (balance < 0) {
+                result = false;
+                break;
+            }
+        }
+        else {
+            balance -= onSquare;
+            if (balance >= 0) {
+                result = true;
+                break;
+            }
+        }
+
+        // Remove the capturing piece and add any x-ray attackers behind it
+        onSquare = SEE_PIECE_VALS[piece];
+        occ ^= single;
+        if (piece == PAWNS || piece == BISHOPS || piece == QUEENS || piece == KINGS)
+            attackers |= getBishopSquares(sq, occ) & diagonals;
+        if (piece == ROOKS || piece == QUEENS || piece == KINGS)
+            attackers |= getRookSquares(sq, occ) & straights;
+        attackers &= occ;
+        side ^= 1;
+        isFirstRecapture = false;
+    }
+
+    if (earlyExit != nullptr)
+        *earlyExit = !exhausted && attackers != 0;
+    return result;
+}
+
 int Board::valueOfPiece(int pieceID) {
     switch(pieceID) {
         // EP capture
@@ -1433,6 +1920,16 @@ inline uint64_t Board::getKnightSquares(int single) {
     return KNIGHTMOVES[single];
 }
 
+#if USE_PEXT
+// With PEXT, the relevant occupancy bits are packed directly into the index
+uint64_t Board::getBishopSquares(int single, uint64_t occ) {
+    return magicBishops[single].table[_pext_u64(occ, magicBishops[single].mask)];
+}
+
+uint64_t Board::getRookSquares(int single, uint64_t occ) {
+    return magicRooks[single].table[_pext_u64(occ, magicRooks[single].mask)];
+}
+#else
 uint64_t Board::getBishopSquares(int single, uint64_t occ) {
     uint64_t *attTableLoc = magicBishops[single].table;
     occ &= magicBishops[single].mask;
@@ -1448,6 +1945,7 @@ uint64_t Board::getRookSquares(int single, uint64_t occ) {
     occ >>= magicRooks[single].shift;
     return attTableLoc[occ];
 }
+#endif
 
 uint64_t Board::getQueenSquares(int single, uint64_t occ) {
     return getBishopSquares(single, occ) | getRookSquares(single, occ);
@@ -1543,11 +2041,18 @@ uint64_t Board::getZobristKey() {
     return zobristKey;
 }
 
+uint64_t Board::getPawnZobristKey() {
+    return pawnZobristKey;
+}
+
 void Board::initZobristKey(int *mailbox) {
     zobristKey = 0;
+    pawnZobristKey = 0;
     for (int i = 0; i < 64; i++) {
         if (mailbox[i] != -1) {
             zobristKey ^= zobristTable[mailbox[i] * 64 + i];
+            if (mailbox[i] % 6 == PAWNS)
+                pawnZobristKey ^= zobristTable[mailbox[i] * 64 + i];
         }
     }
     if (playerToMove == BLACK)
@@ -1555,3 +2060,25 @@ void Board::initZobristKey(int *mailbox) {
     zobristKey ^= zobristTable[769 + castlingRights];
     zobristKey ^= zobristTable[785 + epCaptureFile];
 }
+
+// Computes the incremental eval terms from scratch
+void Board::initEvalTerms() {
+    for (int color = WHITE; color <= BLACK; color++) {
+        psqtScores[color] = EVAL_ZERO;
+        material[MG][color] = material[EG][color] = 0;
+        for (int pieceID = PAWNS; pieceID <= KINGS; pieceID++) {
+            pieceCounts[color][pieceID] = count(pieces[color][pieceID]);
+            if (pieceID != KINGS) {
+                material[MG][color] += PIECE_VALUES[MG][pieceID] * pieceCounts[color][pieceID];
+                material[EG][color] += PIECE_VALUES[EG][pieceID] * pieceCounts[color][pieceID];
+            }
+
+            uint64_t bitboard = pieces[color][pieceID];
+            while (bitboard) {
+                int sq = bitScanForward(bitboard);
+                bitboard &= bitboard - 1;
+                psqtScores[color] += PSQT[color][pieceID][sq];
+            }
+        }
+    }
+}
@@ -68,6 +68,48 @@ struct PieceMoveList {
     PieceMoveInfo get(int i) { return arrayList[i]; }
 };
 
+/**
+ * @brief The state that Board::undoMove() restores, recorded by doMove()
+ * before the move is made.
+ */
+struct UndoInfo {
+    uint64_t zobristKey;
+    uint64_t pawnZobristKey;
+    // The type of the piece captured on the end square, or -1 if none
+    int8_t capturedPiece;
+    uint8_t castlingRights;
+    uint8_t fiftyMoveCounter;
+    uint16_t epCaptureFile;
+};
+
+/**
+ * @brief Pins and checks against the king of the side to move, used to test
+ * pseudo-legal moves for legality without making them.
+ */
+struct LegalityInfo {
+    int kingSq;
+    // Pieces pinned to the king
+    uint64_t pinned;
+    // Squares a non-king move must end on: everything if not in check, the
+    // checker and blocking squares if in single check, nothing if double check
+    uint64_t checkMask;
+};
+
+/**
+ * @brief The squares from which the side to move would give check, computed
+ * once per node so that checking moves can be found without slider lookups.
+ */
+struct CheckInfo {
+    // The opponent's king
+    int kingSq;
+    // For each piece type, the squares from which that piece would attack the
+    // opponent's king
+    uint64_t checkSqs[6];
+    // Pieces of the side to move that are the only blocker between one of
+    // their sliders and the opponent's king, so moving them can discover check
+    uint64_t discoverers;
+};
+
 void initZobristTable();
 
 
@@ -86,13 +128,19 @@ public:
     Board staticCopy();
 
     void doMove(Move m, int color);
+    void doMove(Move m, int color, UndoInfo &undo);
     bool doPseudoLegalMove(Move m, int color);
-    bool doHashMove(Move m, int color);
+    bool doPseudoLegalMove(Move m, int color, UndoInfo &undo);
+    void undoMove(Move m, int color, const UndoInfo &undo);
+    bool doHashMove(Move m, int color, UndoInfo &undo);
+    bool isPseudoLegalQuiet(Move m, int color);
     void doNullMove();
     void undoNullMove(uint16_t _epCaptureFile);
 
     PieceMoveList getPieceMoveList(int color);
     MoveList getAllLegalMoves(int color);
+    LegalityInfo getLegalityInfo(int color);
+    bool isLegalMove(Move m, int color, const LegalityInfo &info);
     void getAllPseudoLegalMoves(MoveList &legalMoves, int color);
     void getPseudoLegalQuiets(MoveList &quiets, int color);
     void getPseudoLegalCaptures(MoveList &captures, int color, bool includePromotions);
@@ -109,7 +157,9 @@ public:
     uint64_t getAttackMap(int color, int sq);
     uint64_t getAttackMap(int sq);
     int getPieceOnSquare(int color, int sq);
+    CheckInfo getCheckInfo(int color);
     bool isCheckMove(int color, Move m);
+    bool isCheckMove(int color, Move m, const CheckInfo &info);
     uint64_t getRookXRays(int sq, uint64_t occ, uint64_t blockers);
     uint64_t getBishopXRays(int sq, uint64_t occ, uint64_t blockers);
     uint64_t getPinnedMap(int color);
@@ -119,13 +169,17 @@ public:
     bool isInsufficientMaterial();
     void getCheckMaps(int color, uint64_t *checkMaps);
 
-    int getMaterial(int color);
+    // Incrementally updated eval terms
+    int getMaterial(int phase, int color);
+    int getPieceCount(int color, int pieceID);
+    Score getPsqtScore(int color);
     // Useful for turning off some pruning late endgame
     uint64_t getNonPawnMaterial(int color);
     // Static exchange evaluation code: for checking material trades on a single square
     uint64_t getLeastValuableAttacker(uint64_t attackers, int color, int &piece);
     int getSEE(int color, int sq);
     int getSEEForMove(int color, Move m);
+    bool getSEEGreaterEqual(int color, Move m, int threshold, bool *earlyExit = nullptr);
     int valueOfPiece(int piece);
     // Most Valuable Victim / Least Valuable Attacker
     int getMVVLVAScore(int color, Move m);
@@ -151,8 +205,11 @@ public:
     uint64_t getAllPieces(int color);
     int *getMailbox();
     uint64_t getZobristKey();
+    uint64_t getZobristKeyAfterMove(Move m, int color);
+    uint64_t getPawnZobristKey();
 
     void initZobristKey(int *mailbox);
+    void initEvalTerms();
 
 private:
     // Bitboards for all white or all black pieces
@@ -162,6 +219,8 @@ private:
     uint64_t pieces[2][6];
     // Zobrist key for hash table use
     uint64_t zobristKey;
+    // Zobrist key of only the pawns, for pawn hash table use
+    uint64_t pawnZobristKey;
     // 8 if cannot en passant, if en passant is possible, the file of the
     // pawn being captured is stored here (0-7)
     uint16_t epCaptureFile;
@@ -177,6 +236,15 @@ private:
     uint8_t castlingRights;
     // Counts half moves for the 50-move rule
     uint8_t fiftyMoveCounter;
+    // Material and piece-square table scores, and the number of each piece,
+    // kept in sync with the bitboards by doMove
+    Score psqtScores[2];
+    int material[2][2];
+    int8_t pieceCounts[2][6];
+
+    void addEvalTerms(int color, int pieceID, int sq);
+    void removeEvalTerms(int color, int pieceID, int sq);
+    void moveEvalTerms(int color, int pieceID, int startSq, int endSq);
 
     void addPawnMovesToList(MoveList &quiets, int color);
     void addPawnCapturesToList(MoveList &captures, int color, uint64_t otherPieces, bool includePromotions);
@@ -205,13 +273,8 @@ private:
     uint64_t getRookSquares(int single, uint64_t occ);
     uint64_t getQueenSquares(int single, uint64_t occ);
     uint64_t getOccupancy();
+    uint64_t getAttackMap(int color, int sq, uint64_t occ);
     int epVictimSquare(int victimColor, uint16_t file);
-
-    // Kindergarten bitboard methods
-    uint64_t rankAttacks(uint64_t occ, int single);
-    uint64_t fileAttacks(uint64_t occ, int single);
-    uint64_t diagAttacks(uint64_t occ, int single);
-    uint64_t antiDiagAttacks(uint64_t occ, int single);
 };
 
 #endif
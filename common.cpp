@@ -16,8 +16,32 @@
     along with Laser.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <vector>
 #include "common.h"
 
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Memory policy for mbind(), from linux/mempolicy.h
+const int MPOL_INTERLEAVE_POLICY = 3;
+
+// Whether large tables are interleaved across NUMA nodes
+static bool interleaveTables = false;
+
 // Used for bit-scan reverse
 const int index64[64] = {
 0,  47,  1, 56, 48, 27,  2, 60,
@@ -97,6 +121,217 @@ uint64_t getTimeElapsed(ChessTime startTime) {
     return (uint64_t) timeSpan.count() + 1;
 }
 
+// Allocates a table aligned to a cache line. On Linux, tables of at least a
+// huge page are aligned to the huge page size and marked for transparent huge
+// pages, which greatly reduces TLB misses for large hash sizes.
+// The memory is not zeroed. Returns nullptr on failure.
+void *allocateTable(uint64_t bytes) {
+    void *table = nullptr;
+#if defined(_WIN32)
+    table = _aligned_malloc(bytes, CACHE_LINE_SIZE);
+#else
+    uint64_t alignment = (bytes >= HUGE_PAGE_SIZE) ? HUGE_PAGE_SIZE : CACHE_LINE_SIZE;
+    if (posix_memalign(&table, alignment, bytes))
+        return nullptr;
+    #if defined(MADV_HUGEPAGE)
+        if (bytes >= HUGE_PAGE_SIZE)
+            madvise(table, bytes, MADV_HUGEPAGE);
+    #endif
+    // Spread the pages round-robin over all NUMA nodes. The kernel ignores
+    // nodes that do not exist, and if this fails we simply fall back to
+    // first-touch placement.
+    #if defined(__linux__) && defined(SYS_mbind)
+        if (interleaveTables && bytes >= HUGE_PAGE_SIZE) {
+            uint64_t allNodes = ~0ULL;
+            syscall(SYS_mbind, table, bytes, MPOL_INTERLEAVE_POLICY,
+                &allNodes, 8 * sizeof(allNodes) + 1, 0);
+        }
+    #endif
+#endif
+    return table;
+}
+
+// Frees a table allocated with allocateTable()
+void freeTable(void *table) {
+#if defined(_WIN32)
+    _aligned_free(table);
+#else
+    free(table);
+#endif
+}
+
+static void bindThisThreadToNode(int node);
+
+// Zeroes a table with the given number of threads. Besides being faster for
+// large tables, this first touches each page from one of several threads. On
+// machines with several NUMA nodes the threads are pinned to the nodes in
+// turn, so that the table is spread evenly over their memory.
+void clearTable(void *table, uint64_t bytes, int threads) {
+    if (threads <= 1 || bytes < 2 * HUGE_PAGE_SIZE) {
+        std::memset(table, 0, bytes);
+        return;
+    }
+
+    // Split on huge page boundaries so that each page is touched by one thread
+    uint64_t chunk = (bytes / threads + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    int nodes = getNumaNodeCount();
+    std::vector<std::thread> workers;
+    for (uint64_t start = 0; start < bytes; start += chunk) {
+        uint64_t length = std::min(chunk, bytes - start);
+        int node = (int) workers.size() % nodes;
+        workers.emplace_back([=] {
+            if (nodes > 1)
+                bindThisThreadToNode(node);
+            std::memset((char *) table + start, 0, length);
+        });
+    }
+    for (std::thread &t : workers)
+        t.join();
+}
+
+// Sets whether tables allocated from now on are interleaved across NUMA nodes
+void setTableInterleave(bool interleave) {
+    interleaveTables = interleave;
+}
+
+#if defined(__linux__)
+/*
+ * The logical CPUs of each NUMA node. Only CPUs the process was allowed to run
+ * on when the topology was first read are used, so binding never overrides a
+ * restriction like taskset. Without NUMA information in /sys, all allowed CPUs
+ * form a single node.
+ */
+struct CpuTopology {
+    std::vector<std::vector<int> > nodes;
+    // The CPUs in node order, so consecutive threads fill one node first
+    std::vector<int> cpus;
+    cpu_set_t allowed;
+};
+
+// Parses a kernel CPU list such as "0-7,16-23"
+static std::vector<int> parseCpuList(const std::string &list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string range = list.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        if (!range.empty() && range.find_first_not_of("0123456789-") == std::string::npos) {
+            int first = std::atoi(range.c_str());
+            int last = (dash == std::string::npos) ? first : std::atoi(range.c_str() + dash + 1);
+            for (int cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+static CpuTopology readCpuTopology() {
+    CpuTopology topology;
+    CPU_ZERO(&topology.allowed);
+    sched_getaffinity(0, sizeof(cpu_set_t), &topology.allowed);
+
+    for (int node = 0; ; node++) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (!file || !std::getline(file, list))
+            break;
+        std::vector<int> cpus;
+        for (int cpu : parseCpuList(list)) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &topology.allowed))
+                cpus.push_back(cpu);
+        }
+        if (!cpus.empty())
+            topology.nodes.push_back(cpus);
+    }
+
+    if (topology.nodes.empty()) {
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &topology.allowed))
+                cpus.push_back(cpu);
+        }
+        topology.nodes.push_back(cpus);
+    }
+
+    for (unsigned int i = 0; i < topology.nodes.size(); i++)
+        topology.cpus.insert(topology.cpus.end(), topology.nodes[i].begin(), topology.nodes[i].end());
+    return topology;
+}
+
+static const CpuTopology &getCpuTopology() {
+    static const CpuTopology topology = readCpuTopology();
+    return topology;
+}
+#endif
+
+// The number of NUMA nodes the process can run on, or 1 if unknown
+int getNumaNodeCount() {
+#if defined(__linux__)
+    return std::max((int) getCpuTopology().nodes.size(), 1);
+#else
+    return 1;
+#endif
+}
+
+// Pins the calling thread to all CPUs of the given NUMA node
+static void bindThisThreadToNode(int node) {
+#if defined(__linux__)
+    const CpuTopology &topology = getCpuTopology();
+    if (node >= (int) topology.nodes.size())
+        return;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu : topology.nodes[node])
+        CPU_SET(cpu, &mask);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &mask);
+#else
+    (void) node;
+#endif
+}
+
+/*
+ * Sets the CPU affinity of the calling thread for the given search thread.
+ * Threads are assigned to CPUs in node order, wrapping around if there are
+ * more threads than CPUs. BIND_NONE restores the affinity the process started
+ * with, since threads inherit the affinity of the thread creating them.
+ * Returns false if binding is not supported or failed.
+ */
+bool bindThisThread(int threadID, ThreadBinding binding) {
+#if defined(__linux__)
+    const CpuTopology &topology = getCpuTopology();
+    if (topology.cpus.empty())
+        return false;
+
+    cpu_set_t mask;
+    if (binding == BIND_NONE)
+        mask = topology.allowed;
+    else {
+        CPU_ZERO(&mask);
+        int cpu = topology.cpus[threadID % topology.cpus.size()];
+        if (binding == BIND_CORES)
+            CPU_SET(cpu, &mask);
+        else {
+            for (unsigned int i = 0; i < topology.nodes.size(); i++) {
+                const std::vector<int> &node = topology.nodes[i];
+                if (std::find(node.begin(), node.end(), cpu) == node.end())
+                    continue;
+                for (int nodeCpu : node)
+                    CPU_SET(nodeCpu, &mask);
+            }
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &mask) == 0;
+#else
+    (void) threadID;
+    (void) binding;
+    return false;
+#endif
+}
+
 std::string moveToString(Move m) {
     char startFile = 'a' + (getStartSq(m) & 7);
     char startRank = '1' + (getStartSq(m) >> 3);
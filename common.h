@@ -24,6 +24,12 @@
 #include <string>
 
 #define USE_INLINE_ASM true
+// Use BMI2 PEXT instead of magic multiplication to index the sliding piece
+// attack tables. Enable with "make USE_PEXT=true" (or "make pext") on CPUs
+// with fast PEXT.
+#ifndef USE_PEXT
+#define USE_PEXT false
+#endif
 
 const int WHITE = 0;
 const int BLACK = 1;
@@ -48,6 +54,28 @@ typedef std::chrono::high_resolution_clock::time_point ChessTime;
 
 uint64_t getTimeElapsed(ChessTime startTime);
 
+// Memory allocation for large tables
+const uint64_t CACHE_LINE_SIZE = 64;
+const uint64_t HUGE_PAGE_SIZE = 2 << 20;
+
+void *allocateTable(uint64_t bytes);
+void freeTable(void *table);
+void clearTable(void *table, uint64_t bytes, int threads);
+void setTableInterleave(bool interleave);
+
+// How search threads are pinned to the CPUs
+enum ThreadBinding {
+    // Leave scheduling to the OS
+    BIND_NONE,
+    // Pin each thread to one logical CPU
+    BIND_CORES,
+    // Pin each thread to all CPUs of one NUMA node
+    BIND_NODES
+};
+
+bool bindThisThread(int threadID, ThreadBinding binding);
+int getNumaNodeCount();
+
 // Bitboard methods
 int bitScanForward(uint64_t bb);
 int bitScanReverse(uint64_t bb);
@@ -58,6 +86,24 @@ inline int relativeRank(int c, int r) {
     return (r ^ (7 * c));
 }
 
+// Eval scores are packed into an unsigned 32-bit integer during calculations
+// (the SWAR technique)
+typedef uint32_t Score;
+
+// Retrieves the final evaluation score to return from the packed eval value
+inline int decEvalMg(Score encodedValue) {
+    return (int) (encodedValue & 0xFFFF) - 0x8000;
+}
+
+inline int decEvalEg(Score encodedValue) {
+    return (int) (encodedValue >> 16) - 0x8000;
+}
+
+// Since we can only work with unsigned numbers due to carryover / twos-complement
+// negative number issues, we make 2^15 the 0 point for each of the two 16-bit
+// halves of Score
+const Score EVAL_ZERO = 0x80008000;
+
 
 /*
  * Moves are represented as an unsigned 16-bit integer.
@@ -23,9 +23,11 @@
 #include "board.h"
 #include "common.h"
 #include "eval.h"
+#include "evalhash.h"
+#include "profile.h"
 #include "uci.h"
 
-static Score PSQT[2][6][64];
+Score PSQT[2][6][64];
 
 void initPSQT() {
     #define E(mg, eg) ((Score) ((((int32_t) eg) << 16) + ((int32_t) mg)))
@@ -166,9 +168,12 @@ void setKingSafetyScale(int s) {
 /*
  * Evaluates the current board position in hundredths of pawns. White is
  * positive and black is negative in traditional negamax format.
+ * If a window is given (from white's point of view), the evaluation may stop
+ * early and return an estimate once the score is clearly outside of it.
  */
 template <bool debug>
-int Eval::evaluate(Board &b) {
+int Eval::evaluate(Board &b, int alpha, int beta) {
+    PROFILE_SCOPE(PROFILE_EVAL);
     // Copy necessary values from Board
     for (int color = WHITE; color <= BLACK; color++) {
         for (int pieceID = PAWNS; pieceID <= KINGS; pieceID++)
@@ -177,23 +182,19 @@ int Eval::evaluate(Board &b) {
     allPieces[WHITE] = b.getAllPieces(WHITE);
     allPieces[BLACK] = b.getAllPieces(BLACK);
     playerToMove = b.getPlayerToMove();
+    evalTier = EVAL_TIER_FULL;
 
-    // Precompute the number of each piece on the board
+    // Piece counts and material totals are maintained incrementally by Board
     int pieceCounts[2][6];
-    for (int color = 0; color < 2; color++) {
-        for (int pieceID = PAWNS; pieceID <= KINGS; pieceID++)
-            pieceCounts[color][pieceID] = count(pieces[color][pieceID]);
-    }
-
-    // Precompute material totals
-    int material[2][2] = {{0, 0}, {0, 0}};
+    int material[2][2];
     int egFactorMaterial = 0;
     for (int color = WHITE; color <= BLACK; color++) {
-        for (int pieceID = PAWNS; pieceID <= QUEENS; pieceID++) {
-            material[MG][color] += PIECE_VALUES[MG][pieceID] * pieceCounts[color][pieceID];
-            material[EG][color] += PIECE_VALUES[EG][pieceID] * pieceCounts[color][pieceID];
+        for (int pieceID = PAWNS; pieceID <= KINGS; pieceID++)
+            pieceCounts[color][pieceID] = b.getPieceCount(color, pieceID);
+        material[MG][color] = b.getMaterial(MG, color);
+        material[EG][color] = b.getMaterial(EG, color);
+        for (int pieceID = PAWNS; pieceID <= QUEENS; pieceID++)
             egFactorMaterial += EG_FACTOR_PIECE_VALS[pieceID] * pieceCounts[color][pieceID];
-        }
     }
 
     // Compute endgame factor which is between 0 and EG_FACTOR_RES, inclusive
@@ -209,26 +210,24 @@ int Eval::evaluate(Board &b) {
     }
 
 
-    // Precompute eval info, such as attack maps
-    PieceMoveList pmlWhite = b.getPieceMoveList(WHITE);
-    PieceMoveList pmlBlack = b.getPieceMoveList(BLACK);
-
     ei.clear();
-
-    // Get the overall attack maps
-    ei.attackMaps[WHITE][PAWNS] = b.getWPawnCaptures(pieces[WHITE][PAWNS]);
-    for (unsigned int i = 0; i < pmlWhite.size(); i++)
-        ei.attackMaps[WHITE][pmlWhite.get(i).pieceID] |= pmlWhite.get(i).legal;
-    ei.attackMaps[BLACK][PAWNS] = b.getBPawnCaptures(pieces[BLACK][PAWNS]);
-    for (unsigned int i = 0; i < pmlBlack.size(); i++)
-        ei.attackMaps[BLACK][pmlBlack.get(i).pieceID] |= pmlBlack.get(i).legal;
-    for (int color = WHITE; color <= BLACK; color++)
-        for (int pieceID = KNIGHTS; pieceID <= QUEENS; pieceID++)
-            ei.fullAttackMaps[color] |= ei.attackMaps[color][pieceID];
-
     ei.rammedPawns[WHITE] = pieces[WHITE][PAWNS] & (pieces[BLACK][PAWNS] >> 8);
     ei.rammedPawns[BLACK] = pieces[BLACK][PAWNS] & (pieces[WHITE][PAWNS] << 8);
 
+    // Probe the pawn hash table for the pawn structure, and calculate it if
+    // necessary. Since pawn scores are offset by EVAL_ZERO, a zero score
+    // marks an entry that has never been written.
+    PawnHashEntry localEntry;
+    PawnHashEntry *phe = &localEntry;
+    if (pawnHash != nullptr) {
+        phe = pawnHash->get(b.getPawnZobristKey());
+        if (phe->pawnKey != b.getPawnZobristKey() || phe->pawnScore[WHITE] == 0) {
+            evaluatePawns(b, phe);
+            phe->pawnKey = b.getPawnZobristKey();
+        }
+    }
+    else
+        evaluatePawns(b, phe);
 
     //---------------------------Material terms---------------------------------
     // Midgame and endgame material
@@ -291,27 +290,46 @@ int Eval::evaluate(Board &b) {
 
 
     //----------------------------Positional terms------------------------------
-    // Pawn piece square tables
-    Score psqtScores[2] = {EVAL_ZERO, EVAL_ZERO};
-    for (int color = WHITE; color <= BLACK; color++) {
-        uint64_t bitboard = pieces[color][PAWNS];
-        while (bitboard) {
-            int sq = bitScanForward(bitboard);
-            bitboard &= bitboard - 1;
-            psqtScores[color] += PSQT[color][PAWNS][sq];
-        }
-    }
-    // Queen piece square tables
-    for (int color = WHITE; color <= BLACK; color++) {
-        uint64_t bitboard = pieces[color][QUEENS];
-        while (bitboard) {
-            int sq = bitScanForward(bitboard);
-            bitboard &= bitboard - 1;
-            psqtScores[color] += PSQT[color][QUEENS][sq];
+    // Piece square tables, maintained incrementally by Board
+    Score psqtScores[2] = {b.getPsqtScore(WHITE), b.getPsqtScore(BLACK)};
+
+    // Scale factors only depend on material, so find them now for lazy eval
+    int scaleFactor = getScaleFactor(b, egFactor, material, pieceCounts);
+
+
+    //--------------------------------Lazy eval---------------------------------
+    // Material, PSQT, and the static pawn structure score are cheap. If they
+    // leave us far outside the window, do not bother with the rest.
+    int lazyMg = decEvalMg(psqtScores[WHITE]) - decEvalMg(psqtScores[BLACK])
+               + decEvalMg(phe->pawnScore[WHITE]) - decEvalMg(phe->pawnScore[BLACK]);
+    int lazyEg = decEvalEg(psqtScores[WHITE]) - decEvalEg(psqtScores[BLACK])
+               + decEvalEg(phe->pawnScore[WHITE]) - decEvalEg(phe->pawnScore[BLACK]);
+    if (!debug) {
+        int lazyEval = getTaperedEval(valueMg + lazyMg, valueEg + lazyEg, egFactor, scaleFactor);
+        if (lazyEval - LAZY_EVAL_MARGIN[EVAL_TIER_MATERIAL] >= beta
+         || lazyEval + LAZY_EVAL_MARGIN[EVAL_TIER_MATERIAL] <= alpha) {
+            evalTier = EVAL_TIER_MATERIAL;
+            return lazyEval;
         }
     }
 
+
     //--------------------------------Mobility----------------------------------
+    // Precompute eval info, such as attack maps
+    PieceMoveList pmlWhite = b.getPieceMoveList(WHITE);
+    PieceMoveList pmlBlack = b.getPieceMoveList(BLACK);
+
+    // Get the overall attack maps
+    ei.attackMaps[WHITE][PAWNS] = b.getWPawnCaptures(pieces[WHITE][PAWNS]);
+    for (unsigned int i = 0; i < pmlWhite.size(); i++)
+        ei.attackMaps[WHITE][pmlWhite.get(i).pieceID] |= pmlWhite.get(i).legal;
+    ei.attackMaps[BLACK][PAWNS] = b.getBPawnCaptures(pieces[BLACK][PAWNS]);
+    for (unsigned int i = 0; i < pmlBlack.size(); i++)
+        ei.attackMaps[BLACK][pmlBlack.get(i).pieceID] |= pmlBlack.get(i).legal;
+    for (int color = WHITE; color <= BLACK; color++)
+        for (int pieceID = KNIGHTS; pieceID <= QUEENS; pieceID++)
+            ei.fullAttackMaps[color] |= ei.attackMaps[color][pieceID];
+
     int whiteMobilityMg, whiteMobilityEg;
     int blackMobilityMg, blackMobilityEg;
     getMobility<WHITE>(pmlWhite, pmlBlack, whiteMobilityMg, whiteMobilityEg);
@@ -333,10 +351,6 @@ int Eval::evaluate(Board &b) {
     uint64_t kingNeighborhood[2] = {b.getKingSquares(kingSq[WHITE]),
                                     b.getKingSquares(kingSq[BLACK])};
 
-    // Calculate king piece square table scores
-    psqtScores[WHITE] += PSQT[WHITE][KINGS][kingSq[WHITE]];
-    psqtScores[BLACK] += PSQT[BLACK][KINGS][kingSq[BLACK]];
-
     int ksValue[2] = {0, 0};
 
     // All king safety terms are midgame only, so don't calculate them in the endgame
@@ -345,36 +359,11 @@ int Eval::evaluate(Board &b) {
             // Pawn shield and storm values: king file and the two adjacent files
             int kingFile = kingSq[color] & 7;
             kingFile = std::min(6, std::max(1, kingFile));
-            for (int i = kingFile-1; i <= kingFile+1; i++) {
-                int f = std::min(i, 7-i);
-
-                uint64_t pawnShield = pieces[color][PAWNS] & FILES[i];
-                if (pawnShield) {
-                    int pawnSq = (color == WHITE) ? bitScanForward(pawnShield)
-                                                  : bitScanReverse(pawnShield);
-                    int r = relativeRank(color, pawnSq >> 3);
-
-                    ksValue[color] += PAWN_SHIELD_VALUE[f][r];
-                }
-                // Semi-open file: no pawn shield
-                else
-                    ksValue[color] += PAWN_SHIELD_VALUE[f][0];
-
-                uint64_t pawnStorm = pieces[color^1][PAWNS] & FILES[i];
-                if (pawnStorm) {
-                    int pawnSq = (color == WHITE) ? bitScanForward(pawnStorm)
-                                                  : bitScanReverse(pawnStorm);
-                    int r = relativeRank(color, pawnSq >> 3);
-                    int stopSq = pawnSq + ((color == WHITE) ? -8 : 8);
-
-                    ksValue[color] -= PAWN_STORM_VALUE[
-                        (pieces[color][PAWNS] & FILES[i]) == 0             ? 0 :
-                        (pieces[color][PAWNS] & INDEX_TO_BIT[stopSq]) != 0 ? 1 : 2][f][r];
-                }
-                // Semi-open file: no pawn for attacker
-                else
-                    ksValue[color] -= PAWN_STORM_VALUE[0][f][0];
+            if (phe->shieldFile[color] != kingFile) {
+                phe->shieldValue[color] = getPawnShield(color, kingFile);
+                phe->shieldFile[color] = kingFile;
             }
+            ksValue[color] += phe->shieldValue[color];
         }
 
         // Piece attacks
@@ -396,18 +385,19 @@ int Eval::evaluate(Board &b) {
         evalDebugStats.blackKingSafety = ksValue[BLACK];
     }
 
-
-    // Get all squares attackable by pawns in the future
-    // Used for outposts and backwards pawns
-    uint64_t wPawnFrontSpan = pieces[WHITE][PAWNS] << 8;
-    uint64_t bPawnFrontSpan = pieces[BLACK][PAWNS] >> 8;
-    for (int i = 0; i < 5; i++) {
-        wPawnFrontSpan |= wPawnFrontSpan << 8;
-        bPawnFrontSpan |= bPawnFrontSpan >> 8;
+    // Second lazy eval check, after the mobility and king safety terms
+    if (!debug) {
+        int lazyEval = getTaperedEval(valueMg + lazyMg, valueEg + lazyEg, egFactor, scaleFactor);
+        if (lazyEval - LAZY_EVAL_MARGIN[EVAL_TIER_KING_SAFETY] >= beta
+         || lazyEval + LAZY_EVAL_MARGIN[EVAL_TIER_KING_SAFETY] <= alpha) {
+            evalTier = EVAL_TIER_KING_SAFETY;
+            return lazyEval;
+        }
     }
-    uint64_t pawnStopAtt[2];
-    pawnStopAtt[WHITE] = ((wPawnFrontSpan >> 1) & NOTH) | ((wPawnFrontSpan << 1) & NOTA);
-    pawnStopAtt[BLACK] = ((bPawnFrontSpan >> 1) & NOTH) | ((bPawnFrontSpan << 1) & NOTA);
+
+
+    // Squares attackable by pawns in the future, used for outposts
+    uint64_t *pawnStopAtt = phe->pawnStopAtt;
 
 
     //------------------------------Minor Pieces--------------------------------
@@ -452,8 +442,6 @@ int Eval::evaluate(Board &b) {
             int knightSq = pml.get(i).startSq;
             uint64_t bit = INDEX_TO_BIT[knightSq];
 
-            psqtScores[color] += PSQT[color][KNIGHTS][knightSq];
-
             // Outposts
             if (bit & ~pawnStopAtt[color^1] & OUTPOST_SQS[color]) {
                 pieceEvalScore[color] += KNIGHT_OUTPOST_BONUS;
@@ -473,8 +461,6 @@ int Eval::evaluate(Board &b) {
             int bishopSq = pml.get(i).startSq;
             uint64_t bit = INDEX_TO_BIT[bishopSq];
 
-            psqtScores[color] += PSQT[color][BISHOPS][bishopSq];
-
             if (bit & ~pawnStopAtt[color^1] & OUTPOST_SQS[color]) {
                 pieceEvalScore[color] += BISHOP_OUTPOST_BONUS;
                 if (bit & ei.attackMaps[color][PAWNS])
@@ -495,7 +481,6 @@ int Eval::evaluate(Board &b) {
             int file = rookSq & 7;
             int rank = rookSq >> 3;
 
-            psqtScores[color] += PSQT[color][ROOKS][rookSq];
 
             // Bonus for having rooks on open or semiopen files
             if (!(FILES[file] & (pieces[color][PAWNS] | pieces[color^1][PAWNS])))
@@ -602,36 +587,15 @@ int Eval::evaluate(Board &b) {
 
 
     //----------------------------Pawn structure--------------------------------
-    Score whitePawnScore = EVAL_ZERO, blackPawnScore = EVAL_ZERO;
+    // Terms which only depend on pawn locations come from the pawn hash entry
+    Score whitePawnScore = phe->pawnScore[WHITE], blackPawnScore = phe->pawnScore[BLACK];
 
     // Passed pawns
-    uint64_t wPassedBlocker = pieces[BLACK][PAWNS] >> 8;
-    uint64_t bPassedBlocker = pieces[WHITE][PAWNS] << 8;
-    // If opposing pawns are on the same or an adjacent file on a pawn's front
-    // span, then the pawn is not passed
-    wPassedBlocker |= ((wPassedBlocker >> 1) & NOTH) | ((wPassedBlocker << 1) & NOTA);
-    bPassedBlocker |= ((bPassedBlocker >> 1) & NOTH) | ((bPassedBlocker << 1) & NOTA);
-    // Include own pawns as blockers to prevent doubled pawns from both being
-    // scored as passers
-    wPassedBlocker |= (pieces[WHITE][PAWNS] >> 8);
-    bPassedBlocker |= (pieces[BLACK][PAWNS] << 8);
-    // Find opposing pawn front spans
-    for(int i = 0; i < 4; i++) {
-        wPassedBlocker |= (wPassedBlocker >> 8);
-        bPassedBlocker |= (bPassedBlocker << 8);
-    }
-    // Passers are pawns outside the opposing pawn front span
-    uint64_t wPassedPawns = pieces[WHITE][PAWNS] & ~wPassedBlocker;
-    uint64_t bPassedPawns = pieces[BLACK][PAWNS] & ~bPassedBlocker;
-
-    uint64_t wPasserTemp = wPassedPawns;
+    uint64_t wPasserTemp = phe->passedPawns[WHITE];
     while (wPasserTemp) {
         int passerSq = bitScanForward(wPasserTemp);
         wPasserTemp &= wPasserTemp - 1;
-        int file = passerSq & 7;
         int rank = passerSq >> 3;
-        whitePawnScore += PASSER_BONUS[rank];
-        whitePawnScore += PASSER_FILE_BONUS[file];
 
         // Non-linear bonus based on rank
         int rFactor = (rank-1) * (rank-2) / 2;
@@ -674,14 +638,11 @@ int Eval::evaluate(Board &b) {
             whitePawnScore += OPP_KING_DIST * getKingDistance(passerSq+8, kingSq[BLACK]) * rFactor;
         }
     }
-    uint64_t bPasserTemp = bPassedPawns;
+    uint64_t bPasserTemp = phe->passedPawns[BLACK];
     while (bPasserTemp) {
         int passerSq = bitScanForward(bPasserTemp);
         bPasserTemp &= bPasserTemp - 1;
-        int file = passerSq & 7;
         int rank = 7 - (passerSq >> 3);
-        blackPawnScore += PASSER_BONUS[rank];
-        blackPawnScore += PASSER_FILE_BONUS[file];
 
         int rFactor = (rank-1) * (rank-2) / 2;
         if (rFactor) {
@@ -717,6 +678,179 @@ int Eval::evaluate(Board &b) {
         }
     }
 
+    valueMg += decEvalMg(whitePawnScore) - decEvalMg(blackPawnScore);
+    valueEg += decEvalEg(whitePawnScore) - decEvalEg(blackPawnScore);
+
+    if (debug) {
+        evalDebugStats.whitePawnScore = whitePawnScore;
+        evalDebugStats.blackPawnScore = blackPawnScore;
+    }
+
+
+    // King-pawn tropism
+    int kingPawnTropism = 0;
+    if (egFactor > 0) {
+        uint64_t pawnBits = pieces[WHITE][PAWNS] | pieces[BLACK][PAWNS];
+        int pawnWeight = 0;
+
+        int wTropismTotal = 0, bTropismTotal = 0;
+        while (pawnBits) {
+            int pawnSq = bitScanForward(pawnBits);
+            pawnBits &= pawnBits - 1;
+
+            wTropismTotal += getManhattanDistance(pawnSq, kingSq[WHITE]);
+            bTropismTotal += getManhattanDistance(pawnSq, kingSq[BLACK]);
+            pawnWeight++;
+        }
+
+        if (pawnWeight)
+            kingPawnTropism = (bTropismTotal - wTropismTotal) / pawnWeight;
+
+        valueEg += KING_TROPISM_VALUE * kingPawnTropism;
+    }
+
+
+    if (debug) {
+        evalDebugStats.totalMg = valueMg;
+        evalDebugStats.totalEg = valueEg;
+    }
+
+    int totalEval = getTaperedEval(valueMg, valueEg, egFactor, scaleFactor);
+
+
+    if (debug) {
+        evalDebugStats.totalEval = totalEval;
+        evalDebugStats.print();
+    }
+
+    return totalEval;
+}
+
+// Explicitly instantiate templates
+template int Eval::evaluate<true>(Board &b, int alpha, int beta);
+template int Eval::evaluate<false>(Board &b, int alpha, int beta);
+
+/*
+ * Finds how much to scale down the eval for drawish material configurations,
+ * out of MAX_SCALE_FACTOR.
+ */
+int Eval::getScaleFactor(Board &b, int egFactor, int material[2][2], int pieceCounts[2][6]) {
+    int scaleFactor = MAX_SCALE_FACTOR;
+    // Opposite colored bishops
+    if (egFactor > 3 * EG_FACTOR_RES / 4) {
+        if (pieceCounts[WHITE][BISHOPS] == 1
+         && pieceCounts[BLACK][BISHOPS] == 1
+         && (((pieces[WHITE][BISHOPS] & LIGHT) && (pieces[BLACK][BISHOPS] & DARK))
+          || ((pieces[WHITE][BISHOPS] & DARK) && (pieces[BLACK][BISHOPS] & LIGHT)))) {
+            if ((b.getNonPawnMaterial(WHITE) == pieces[WHITE][BISHOPS])
+             && (b.getNonPawnMaterial(BLACK) == pieces[BLACK][BISHOPS]))
+                scaleFactor = OPPOSITE_BISHOP_SCALING[0];
+            else
+                scaleFactor = OPPOSITE_BISHOP_SCALING[1];
+        }
+    }
+    // Reduce eval for lack of pawns
+    if (material[MG][WHITE] - material[MG][BLACK] > 0
+     && material[MG][WHITE] - material[MG][BLACK] <= PIECE_VALUES[MG][KNIGHTS]
+     && pieceCounts[WHITE][PAWNS] <= 1) {
+        if (pieceCounts[WHITE][PAWNS] == 0) {
+            if (material[MG][WHITE] < PIECE_VALUES[MG][BISHOPS] + 50)
+                scaleFactor = PAWNLESS_SCALING[0];
+            else if (material[MG][BLACK] <= PIECE_VALUES[MG][BISHOPS])
+                scaleFactor = PAWNLESS_SCALING[1];
+            else
+                scaleFactor = PAWNLESS_SCALING[2];
+        }
+        else {
+            scaleFactor = PAWNLESS_SCALING[3];
+        }
+    }
+    if (material[MG][BLACK] - material[MG][WHITE] > 0
+     && material[MG][BLACK] - material[MG][WHITE] <= PIECE_VALUES[MG][KNIGHTS]
+     && pieceCounts[BLACK][PAWNS] <= 1) {
+        if (pieceCounts[BLACK][PAWNS] == 0) {
+            if (material[MG][BLACK] < PIECE_VALUES[MG][BISHOPS] + 50)
+                scaleFactor = PAWNLESS_SCALING[0];
+            else if (material[MG][WHITE] <= PIECE_VALUES[MG][BISHOPS])
+                scaleFactor = PAWNLESS_SCALING[1];
+            else
+                scaleFactor = PAWNLESS_SCALING[2];
+        }
+        else {
+            scaleFactor = PAWNLESS_SCALING[3];
+        }
+    }
+
+    return scaleFactor;
+}
+
+// Interpolates between the midgame and endgame scores, and applies the scale factor
+int Eval::getTaperedEval(int valueMg, int valueEg, int egFactor, int scaleFactor) {
+    int totalEval = (valueMg * (EG_FACTOR_RES - egFactor) + valueEg * egFactor) / EG_FACTOR_RES;
+    if (scaleFactor < MAX_SCALE_FACTOR)
+        totalEval = totalEval * scaleFactor / MAX_SCALE_FACTOR;
+    return totalEval;
+}
+
+/*
+ * Calculates the pawn structure terms which only depend on the locations of
+ * pawns, and stores them in a pawn hash entry.
+ */
+void Eval::evaluatePawns(Board &b, PawnHashEntry *phe) {
+    Score whitePawnScore = EVAL_ZERO, blackPawnScore = EVAL_ZERO;
+    uint64_t pawnAttacks[2] = {b.getWPawnCaptures(pieces[WHITE][PAWNS]),
+                               b.getBPawnCaptures(pieces[BLACK][PAWNS])};
+
+    // Get all squares attackable by pawns in the future
+    // Used for outposts and backwards pawns
+    uint64_t wPawnFrontSpan = pieces[WHITE][PAWNS] << 8;
+    uint64_t bPawnFrontSpan = pieces[BLACK][PAWNS] >> 8;
+    for (int i = 0; i < 5; i++) {
+        wPawnFrontSpan |= wPawnFrontSpan << 8;
+        bPawnFrontSpan |= bPawnFrontSpan >> 8;
+    }
+    uint64_t *pawnStopAtt = phe->pawnStopAtt;
+    pawnStopAtt[WHITE] = ((wPawnFrontSpan >> 1) & NOTH) | ((wPawnFrontSpan << 1) & NOTA);
+    pawnStopAtt[BLACK] = ((bPawnFrontSpan >> 1) & NOTH) | ((bPawnFrontSpan << 1) & NOTA);
+
+    // Passed pawns
+    uint64_t wPassedBlocker = pieces[BLACK][PAWNS] >> 8;
+    uint64_t bPassedBlocker = pieces[WHITE][PAWNS] << 8;
+    // If opposing pawns are on the same or an adjacent file on a pawn's front
+    // span, then the pawn is not passed
+    wPassedBlocker |= ((wPassedBlocker >> 1) & NOTH) | ((wPassedBlocker << 1) & NOTA);
+    bPassedBlocker |= ((bPassedBlocker >> 1) & NOTH) | ((bPassedBlocker << 1) & NOTA);
+    // Include own pawns as blockers to prevent doubled pawns from both being
+    // scored as passers
+    wPassedBlocker |= (pieces[WHITE][PAWNS] >> 8);
+    bPassedBlocker |= (pieces[BLACK][PAWNS] << 8);
+    // Find opposing pawn front spans
+    for(int i = 0; i < 4; i++) {
+        wPassedBlocker |= (wPassedBlocker >> 8);
+        bPassedBlocker |= (bPassedBlocker << 8);
+    }
+    // Passers are pawns outside the opposing pawn front span
+    uint64_t wPassedPawns = pieces[WHITE][PAWNS] & ~wPassedBlocker;
+    uint64_t bPassedPawns = pieces[BLACK][PAWNS] & ~bPassedBlocker;
+
+    phe->passedPawns[WHITE] = wPassedPawns;
+    phe->passedPawns[BLACK] = bPassedPawns;
+
+    uint64_t wPasserTemp = wPassedPawns;
+    while (wPasserTemp) {
+        int passerSq = bitScanForward(wPasserTemp);
+        wPasserTemp &= wPasserTemp - 1;
+        whitePawnScore += PASSER_BONUS[passerSq >> 3];
+        whitePawnScore += PASSER_FILE_BONUS[passerSq & 7];
+    }
+    uint64_t bPasserTemp = bPassedPawns;
+    while (bPasserTemp) {
+        int passerSq = bitScanForward(bPasserTemp);
+        bPasserTemp &= bPasserTemp - 1;
+        blackPawnScore += PASSER_BONUS[7 - (passerSq >> 3)];
+        blackPawnScore += PASSER_FILE_BONUS[passerSq & 7];
+    }
+
     // Doubled pawns
     whitePawnScore += DOUBLED_PENALTY * count(pieces[WHITE][PAWNS] & (pieces[WHITE][PAWNS] << 8));
     blackPawnScore += DOUBLED_PENALTY * count(pieces[BLACK][PAWNS] & (pieces[BLACK][PAWNS] >> 8));
@@ -767,15 +901,15 @@ int Eval::evaluate(Board &b) {
     }
 
     // Backward pawns
-    uint64_t wBadStopSqs = ~pawnStopAtt[WHITE] & ei.attackMaps[BLACK][PAWNS];
-    uint64_t bBadStopSqs = ~pawnStopAtt[BLACK] & ei.attackMaps[WHITE][PAWNS];
+    uint64_t wBadStopSqs = ~pawnStopAtt[WHITE] & pawnAttacks[BLACK];
+    uint64_t bBadStopSqs = ~pawnStopAtt[BLACK] & pawnAttacks[WHITE];
     for (int i = 0; i < 6; i++) {
         wBadStopSqs |= wBadStopSqs >> 8;
         bBadStopSqs |= bBadStopSqs << 8;
     }
 
-    uint64_t wBackwards = wBadStopSqs & pieces[WHITE][PAWNS] & ~wIsolatedBB & ~ei.attackMaps[BLACK][PAWNS];
-    uint64_t bBackwards = bBadStopSqs & pieces[BLACK][PAWNS] & ~bIsolatedBB & ~ei.attackMaps[WHITE][PAWNS];
+    uint64_t wBackwards = wBadStopSqs & pieces[WHITE][PAWNS] & ~wIsolatedBB & ~pawnAttacks[BLACK];
+    uint64_t bBackwards = bBadStopSqs & pieces[BLACK][PAWNS] & ~bIsolatedBB & ~pawnAttacks[WHITE];
     whitePawnScore += BACKWARD_PENALTY * count(wBackwards);
     blackPawnScore += BACKWARD_PENALTY * count(bBackwards);
 
@@ -800,8 +934,8 @@ int Eval::evaluate(Board &b) {
     }
 
     // Undefended pawns
-    uint64_t wUndefendedPawns = pieces[WHITE][PAWNS] & ~ei.attackMaps[WHITE][PAWNS] & ~wBackwards & ~wIsolatedBB;
-    uint64_t bUndefendedPawns = pieces[BLACK][PAWNS] & ~ei.attackMaps[BLACK][PAWNS] & ~bBackwards & ~bIsolatedBB;
+    uint64_t wUndefendedPawns = pieces[WHITE][PAWNS] & ~pawnAttacks[WHITE] & ~wBackwards & ~wIsolatedBB;
+    uint64_t bUndefendedPawns = pieces[BLACK][PAWNS] & ~pawnAttacks[BLACK] & ~bBackwards & ~bIsolatedBB;
     whitePawnScore += UNDEFENDED_PAWN_PENALTY * count(wUndefendedPawns);
     blackPawnScore += UNDEFENDED_PAWN_PENALTY * count(bUndefendedPawns);
 
@@ -832,8 +966,8 @@ int Eval::evaluate(Board &b) {
     }
 
     // Other connected pawns
-    uint64_t wConnected = pieces[WHITE][PAWNS] & ei.attackMaps[WHITE][PAWNS];
-    uint64_t bConnected = pieces[BLACK][PAWNS] & ei.attackMaps[BLACK][PAWNS];
+    uint64_t wConnected = pieces[WHITE][PAWNS] & pawnAttacks[WHITE];
+    uint64_t bConnected = pieces[BLACK][PAWNS] & pawnAttacks[BLACK];
     while (wConnected) {
         int pawnSq = bitScanForward(wConnected);
         wConnected &= wConnected - 1;
@@ -854,109 +988,50 @@ int Eval::evaluate(Board &b) {
         if (!(FILES[f] & pieces[WHITE][PAWNS]))
             blackPawnScore += bonus;
     }
-    
-    valueMg += decEvalMg(whitePawnScore) - decEvalMg(blackPawnScore);
-    valueEg += decEvalEg(whitePawnScore) - decEvalEg(blackPawnScore);
-
-    if (debug) {
-        evalDebugStats.whitePawnScore = whitePawnScore;
-        evalDebugStats.blackPawnScore = blackPawnScore;
-    }
-
-
-    // King-pawn tropism
-    int kingPawnTropism = 0;
-    if (egFactor > 0) {
-        uint64_t pawnBits = pieces[WHITE][PAWNS] | pieces[BLACK][PAWNS];
-        int pawnWeight = 0;
-
-        int wTropismTotal = 0, bTropismTotal = 0;
-        while (pawnBits) {
-            int pawnSq = bitScanForward(pawnBits);
-            pawnBits &= pawnBits - 1;
-
-            wTropismTotal += getManhattanDistance(pawnSq, kingSq[WHITE]);
-            bTropismTotal += getManhattanDistance(pawnSq, kingSq[BLACK]);
-            pawnWeight++;
-        }
-
-        if (pawnWeight)
-            kingPawnTropism = (bTropismTotal - wTropismTotal) / pawnWeight;
-
-        valueEg += KING_TROPISM_VALUE * kingPawnTropism;
-    }
 
+    phe->pawnScore[WHITE] = whitePawnScore;
+    phe->pawnScore[BLACK] = blackPawnScore;
+    // The pawn shield is filled in as needed
+    phe->shieldFile[WHITE] = phe->shieldFile[BLACK] = -1;
+}
 
-    if (debug) {
-        evalDebugStats.totalMg = valueMg;
-        evalDebugStats.totalEg = valueEg;
-    }
+// Scores the pawn shield and pawn storm of the king file and the two adjacent files
+int Eval::getPawnShield(int color, int kingFile) {
+    int value = 0;
+    for (int i = kingFile-1; i <= kingFile+1; i++) {
+        int f = std::min(i, 7-i);
 
-    int totalEval = (valueMg * (EG_FACTOR_RES - egFactor) + valueEg * egFactor) / EG_FACTOR_RES;
+        uint64_t pawnShield = pieces[color][PAWNS] & FILES[i];
+        if (pawnShield) {
+            int pawnSq = (color == WHITE) ? bitScanForward(pawnShield)
+                                          : bitScanReverse(pawnShield);
+            int r = relativeRank(color, pawnSq >> 3);
 
-    // Scale factors
-    int scaleFactor = MAX_SCALE_FACTOR;
-    // Opposite colored bishops
-    if (egFactor > 3 * EG_FACTOR_RES / 4) {
-        if (pieceCounts[WHITE][BISHOPS] == 1
-         && pieceCounts[BLACK][BISHOPS] == 1
-         && (((pieces[WHITE][BISHOPS] & LIGHT) && (pieces[BLACK][BISHOPS] & DARK))
-          || ((pieces[WHITE][BISHOPS] & DARK) && (pieces[BLACK][BISHOPS] & LIGHT)))) {
-            if ((b.getNonPawnMaterial(WHITE) == pieces[WHITE][BISHOPS])
-             && (b.getNonPawnMaterial(BLACK) == pieces[BLACK][BISHOPS]))
-                scaleFactor = OPPOSITE_BISHOP_SCALING[0];
-            else
-                scaleFactor = OPPOSITE_BISHOP_SCALING[1];
-        }
-    }
-    // Reduce eval for lack of pawns
-    if (material[MG][WHITE] - material[MG][BLACK] > 0
-     && material[MG][WHITE] - material[MG][BLACK] <= PIECE_VALUES[MG][KNIGHTS]
-     && pieceCounts[WHITE][PAWNS] <= 1) {
-        if (pieceCounts[WHITE][PAWNS] == 0) {
-            if (material[MG][WHITE] < PIECE_VALUES[MG][BISHOPS] + 50)
-                scaleFactor = PAWNLESS_SCALING[0];
-            else if (material[MG][BLACK] <= PIECE_VALUES[MG][BISHOPS])
-                scaleFactor = PAWNLESS_SCALING[1];
-            else
-                scaleFactor = PAWNLESS_SCALING[2];
+            value += PAWN_SHIELD_VALUE[f][r];
         }
-        else {
-            scaleFactor = PAWNLESS_SCALING[3];
+        // Semi-open file: no pawn shield
+        else
+            value += PAWN_SHIELD_VALUE[f][0];
+
+        uint64_t pawnStorm = pieces[color^1][PAWNS] & FILES[i];
+        if (pawnStorm) {
+            int pawnSq = (color == WHITE) ? bitScanForward(pawnStorm)
+                                          : bitScanReverse(pawnStorm);
+            int r = relativeRank(color, pawnSq >> 3);
+            int stopSq = pawnSq + ((color == WHITE) ? -8 : 8);
+
+            value -= PAWN_STORM_VALUE[
+                (pieces[color][PAWNS] & FILES[i]) == 0             ? 0 :
+                (pieces[color][PAWNS] & INDEX_TO_BIT[stopSq]) != 0 ? 1 : 2][f][r];
         }
-    }
-    if (material[MG][BLACK] - material[MG][WHITE] > 0
-     && material[MG][BLACK] - material[MG][WHITE] <= PIECE_VALUES[MG][KNIGHTS]
-     && pieceCounts[BLACK][PAWNS] <= 1) {
-        if (pieceCounts[BLACK][PAWNS] == 0) {
-            if (material[MG][BLACK] < PIECE_VALUES[MG][BISHOPS] + 50)
-                scaleFactor = PAWNLESS_SCALING[0];
-            else if (material[MG][WHITE] <= PIECE_VALUES[MG][BISHOPS])
-                scaleFactor = PAWNLESS_SCALING[1];
-            else
-                scaleFactor = PAWNLESS_SCALING[2];
-        }
-        else {
-            scaleFactor = PAWNLESS_SCALING[3];
-        }
-    }
-
-    if (scaleFactor < MAX_SCALE_FACTOR)
-        totalEval = totalEval * scaleFactor / MAX_SCALE_FACTOR;
-
-
-    if (debug) {
-        evalDebugStats.totalEval = totalEval;
-        evalDebugStats.print();
+        // Semi-open file: no pawn for attacker
+        else
+            value -= PAWN_STORM_VALUE[0][f][0];
     }
 
-    return totalEval;
+    return value;
 }
 
-// Explicitly instantiate templates
-template int Eval::evaluate<true>(Board &b);
-template int Eval::evaluate<false>(Board &b);
-
 // Scores the board for a player based on estimates of mobility. This function
 // also calculates control of center.
 template <int color>
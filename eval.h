@@ -24,6 +24,11 @@
 #include "common.h"
 
 class Board;
+class PawnHash;
+struct PawnHashEntry;
+
+// Piece-square tables, indexed by [color][piece][square]
+extern Score PSQT[2][6][64];
 
 void initPSQT();
 void setMaterialScale(int s);
@@ -41,15 +46,26 @@ struct EvalInfo {
 
 class Eval {
 public:
-  template <bool debug = false> int evaluate(Board &b);
+  Eval(PawnHash *_pawnHash = nullptr) : pawnHash(_pawnHash) {}
+
+  template <bool debug = false> int evaluate(Board &b, int alpha = -INFTY, int beta = INFTY);
+  // The furthest stage reached by the last evaluation
+  int getEvalTier() { return evalTier; }
 
 private:
+  // Pawn hash table of the calling thread, if any
+  PawnHash *pawnHash;
   EvalInfo ei;
   uint64_t pieces[2][6];
   uint64_t allPieces[2];
   int playerToMove;
+  int evalTier;
 
   // Eval helpers
+  void evaluatePawns(Board &b, PawnHashEntry *phe);
+  int getPawnShield(int color, int kingFile);
+  int getScaleFactor(Board &b, int egFactor, int material[2][2], int pieceCounts[2][6]);
+  int getTaperedEval(int valueMg, int valueEg, int egFactor, int scaleFactor);
   template <int color>
   void getMobility(PieceMoveList &pml, PieceMoveList &oppPml, int &valueMg, int &valueEg);
   template <int attackingColor>
@@ -68,27 +84,16 @@ const int EG_FACTOR_ALPHA = 2340;
 const int EG_FACTOR_BETA = 6380;
 const int EG_FACTOR_RES = 1000;
 
-// Eval scores are packed into an unsigned 32-bit integer during calculations
-// (the SWAR technique)
-typedef uint32_t Score;
+// Lazy eval: the stages an evaluation can stop at, and how far outside of the
+// window the score must be after each stage to stop there
+const int EVAL_TIER_MATERIAL = 0;
+const int EVAL_TIER_KING_SAFETY = 1;
+const int EVAL_TIER_FULL = 2;
+const int LAZY_EVAL_MARGIN[2] = {520, 320};
 
 // Encodes 16-bit midgame and endgame evaluation scores into a single int
 #define E(mg, eg) ((Score) ((((int32_t) eg) << 16) + ((int32_t) mg)))
 
-// Retrieves the final evaluation score to return from the packed eval value
-inline int decEvalMg(Score encodedValue) {
-    return (int) (encodedValue & 0xFFFF) - 0x8000;
-}
-
-inline int decEvalEg(Score encodedValue) {
-    return (int) (encodedValue >> 16) - 0x8000;
-}
-
-// Since we can only work with unsigned numbers due to carryover / twos-complement
-// negative number issues, we make 2^15 the 0 point for each of the two 16-bit
-// halves of Score
-const Score EVAL_ZERO = 0x80008000;
-
 // Array indexing constants
 const int MG = 0;
 const int EG = 1;
@@ -16,62 +16,91 @@
     along with Laser.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cstdlib>
 #include <cstring>
 #include "evalhash.h"
 
 EvalHash::EvalHash(uint64_t MB) {
-    init(MB);
+    init(MB, 1);
 }
 
 EvalHash::~EvalHash() {
-    free(table);
+    freeTable(table);
 }
 
-// Adds key and move into the hashtable. This function assumes that the key has
-// been checked with get and is not in the table.
+// Adds key and score into the hashtable. This function assumes that the key
+// has been checked with get and is not in the table. The new entry goes in the
+// first slot, and the oldest entry is evicted if the bucket is full.
 void EvalHash::add(Board &b, int score) {
-    // Use the lower 32 bits of the hash key to index the array
-    uint32_t h = (uint32_t) (b.getZobristKey() & 0xFFFFFFFF);
-    uint32_t index = h & (size-1);
-
-    table[index].setEntry(b, score);
+    uint64_t h = b.getZobristKey();
+    EvalHashNode *node = table + (h & (size-1));
+    uint64_t entry = (h & ~0xFFFFULL) | (uint16_t) (score + 0x8000);
+
+    for (int i = NUM_EVAL_HASH_SLOTS - 1; i > 0; i--) {
+        node->slots[i].store(node->slots[i-1].load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+    }
+    node->slots[0].store(entry, std::memory_order_relaxed);
 }
 
 // Get the hash entry, if any, associated with a board b.
-int EvalHash::get(Board &b) {
-    // Use the lower 32 bits of the hash key to index the array
-    uint32_t h = (uint32_t) (b.getZobristKey() & 0xFFFFFFFF);
-    uint32_t index = h & (size-1);
-
-    if ((table[index].zobristKey ^ table[index].score) == (uint32_t) (b.getZobristKey() >> 32))
-        return table[index].score;
+int EvalHash::get(Board &b, EvalHashProbe &probe) {
+    uint64_t h = b.getZobristKey();
+    EvalHashNode *node = table + (h & (size-1));
+
+    probe = EVAL_HASH_COLLISION;
+    for (int i = 0; i < NUM_EVAL_HASH_SLOTS; i++) {
+        uint64_t entry = node->slots[i].load(std::memory_order_relaxed);
+        if (entry == 0) {
+            probe = EVAL_HASH_MISS;
+            break;
+        }
+        if ((entry ^ h) >> 16 == 0) {
+            probe = EVAL_HASH_HIT;
+            return (int) (entry & 0xFFFF) - 0x8000 + EVAL_HASH_OFFSET;
+        }
+    }
 
     // Because of the offset, 0 will not be a valid returned score. Thus we can use
     // this to indicate no match found.
     return 0;
 }
 
-void EvalHash::setSize(uint64_t MB) {
-    free(table);
-    init(MB);
+void EvalHash::setSize(uint64_t MB, int threads) {
+    freeTable(table);
+    init(MB, threads);
 }
 
-void EvalHash::init(uint64_t MB) {
+void EvalHash::init(uint64_t MB, int threads) {
     // Convert to bytes
     uint64_t bytes = MB << 20;
     // Calculate how many array slots we can use
-    uint64_t maxSize = bytes / sizeof(EvalHashEntry);
+    uint64_t maxSize = bytes / sizeof(EvalHashNode);
 
     size = 1;
     while (size <= maxSize)
         size <<= 1;
     size >>= 1;
 
-    table = (EvalHashEntry *) calloc(size, sizeof(EvalHashEntry));
-    keys = 0;
+    table = (EvalHashNode *) allocateTable(size * sizeof(EvalHashNode));
+    clear(threads);
 }
 
-void EvalHash::clear() {
-    std::memset(table, 0, size * sizeof(EvalHashEntry));
+// Clears the table, splitting the work over the given number of threads
+void EvalHash::clear(int threads) {
+    clearTable(table, size * sizeof(EvalHashNode), threads);
     keys = 0;
 }
+
+
+PawnHash::PawnHash() {
+    table = (PawnHashEntry *) calloc(PAWN_HASH_SIZE, sizeof(PawnHashEntry));
+}
+
+PawnHash::~PawnHash() {
+    free(table);
+}
+
+void PawnHash::clear() {
+    std::memset(table, 0, PAWN_HASH_SIZE * sizeof(PawnHashEntry));
+}
@@ -19,44 +19,44 @@
 #ifndef __EVALHASH_H__
 #define __EVALHASH_H__
 
+#include <atomic>
 #include "board.h"
 #include "common.h"
+#include "eval.h"
 
 
-// Offset so that we can always store a positive value in EvalHashEntry
+// Offset so that we can always return a positive value from EvalHash::get
 const int EVAL_HASH_OFFSET = (1 << 20);
 
+const int NUM_EVAL_HASH_SLOTS = 8;
+
 /*
- * @brief Struct storing hashed eval information
- * Size: 8 bytes
+ * @brief A bucket of eval cache entries filling one 64-byte cache line.
+ *
+ * Each entry packs the upper 48 bits of the Zobrist key with the score biased
+ * into the low 16 bits, so that it is read and written as a single atomic word
+ * and can never be torn by a concurrent write. The lower bits of the key are
+ * implied by the bucket index, so for tables of at least 2^16 buckets (4 MB)
+ * the whole key is verified. An empty entry is 0, which no biased score uses.
+ * Slots are kept in insertion order, with the newest entry first.
  */
-struct EvalHashEntry {
-    uint32_t zobristKey;
-    uint32_t score;
-
-    EvalHashEntry() {
-        clearEntry();
-    }
-
-    void setEntry(Board &b, int _score) {
-        score = (uint32_t) (_score + EVAL_HASH_OFFSET);
-        zobristKey = ((uint32_t) (b.getZobristKey() >> 32)) ^ score;
-    }
-
-    void clearEntry() {
-        zobristKey = 0;
-        score = 0;
-    }
+struct alignas(64) EvalHashNode {
+    std::atomic<uint64_t> slots[NUM_EVAL_HASH_SLOTS];
+};
 
-    ~EvalHashEntry() {}
+// The outcome of an eval cache probe, recorded in the search statistics
+enum EvalHashProbe {
+    EVAL_HASH_HIT, EVAL_HASH_MISS,
+    // A miss in a full bucket: adding the entry will evict another position
+    EVAL_HASH_COLLISION
 };
 
 class EvalHash {
 private:
-    EvalHashEntry *table;
+    EvalHashNode *table;
     uint64_t size;
 
-    void init(uint64_t MB);
+    void init(uint64_t MB, int threads);
 
 public:
     uint64_t keys;
@@ -67,8 +67,54 @@ public:
     ~EvalHash();
 
     void add(Board &b, int score);
-    int get(Board &b);
-    void setSize(uint64_t MB);
+    int get(Board &b, EvalHashProbe &probe);
+    void prefetch(uint64_t key) {
+        __builtin_prefetch(table + (key & (size-1)));
+    }
+    void setSize(uint64_t MB, int threads);
+    void clear(int threads);
+};
+
+
+// Number of entries in each thread's pawn hash table
+const uint64_t PAWN_HASH_SIZE = 1 << 14;
+
+/*
+ * @brief Struct storing the parts of the evaluation which only depend on the
+ * locations of pawns.
+ * Size: 56 bytes
+ */
+struct PawnHashEntry {
+    uint64_t pawnKey;
+    Score pawnScore[2];
+    uint64_t passedPawns[2];
+    // Squares attackable by pawns in the future
+    uint64_t pawnStopAtt[2];
+    // Pawn shield and storm values for the (clamped) king file given in
+    // shieldFile, or -1 if not yet calculated
+    int16_t shieldValue[2];
+    int8_t shieldFile[2];
+};
+
+/*
+ * A per-thread cache of pawn structure evaluations, indexed by the pawn-only
+ * Zobrist key of a position.
+ */
+class PawnHash {
+private:
+    PawnHashEntry *table;
+
+public:
+    PawnHash();
+    PawnHash(const PawnHash &other) = delete;
+    PawnHash& operator=(const PawnHash &other) = delete;
+    ~PawnHash();
+
+    // Returns the entry a pawn key maps to. The caller must check that the
+    // key matches and fill in the entry otherwise.
+    PawnHashEntry *get(uint64_t pawnKey) {
+        return table + (pawnKey & (PAWN_HASH_SIZE-1));
+    }
     void clear();
 };
 
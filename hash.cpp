@@ -16,8 +16,17 @@
     along with Laser.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cstdio>
 #include <cstring>
 #include "hash.h"
+#include "profile.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 /*
  * Packs the data into a single 64-bit integer using the following format:
@@ -43,74 +52,75 @@ uint64_t packHashData(int depth, Move m, int score, uint8_t nodeType, uint8_t ag
 }
 
 Hash::Hash(uint64_t MB) {
-    init(MB);
+    init(MB, 1);
 }
 
 Hash::~Hash() {
-    free(table);
+    release();
 }
 
 // Adds key and move into the hashtable. This function assumes that the key has
 // been checked with get and is not in the table.
 void Hash::add(Board &b, uint64_t data, int depth, uint8_t age) {
+    PROFILE_SCOPE(PROFILE_TT_STORE);
     uint64_t h = b.getZobristKey();
     uint64_t index = h & (size-1);
     HashNode *node = table + index;
 
     // Decide whether to replace the entry
     // A more recent update to the same position should always be chosen
-    if ((node->slot1.zobristKey ^ node->slot1.data) == b.getZobristKey())
-        node->slot1.setEntry(b, data);
-    
-    else if ((node->slot2.zobristKey ^ node->slot2.data) == b.getZobristKey())
-        node->slot2.setEntry(b, data);
-    
+    for (int i = 0; i < NUM_HASH_SLOTS; i++) {
+        if ((node->slots[i].zobristKey ^ node->slots[i].data) == h) {
+            node->slots[i].setEntry(b, data);
+            return;
+        }
+    }
+
     // Replace an entry from a previous search space, or the lowest
     // depth entry with the new entry if the new entry's depth is higher
-    else {
-        HashEntry *toReplace = NULL;
-        int score1 = 128*((int) (age - getHashAge(node->slot1.data)))
-            + depth - getHashDepth(node->slot1.data);
-        int score2 = 128*((int) (age - getHashAge(node->slot2.data)))
-            + depth - getHashDepth(node->slot2.data);
-        if (score1 >= score2)
-            toReplace = &(node->slot1);
-        else
-            toReplace = &(node->slot2);
-        // The node must be from a newer search space or be a
-        // higher depth if from the same search space.
-        if (score1 < -2 && score2 < -2)
-            toReplace = NULL;
-
-        if (toReplace != NULL) 
-            toReplace->setEntry(b, data);
+    HashEntry *toReplace = &(node->slots[0]);
+    int bestScore = 128*((int) (age - getHashAge(node->slots[0].data)))
+        + depth - getHashDepth(node->slots[0].data);
+    for (int i = 1; i < NUM_HASH_SLOTS; i++) {
+        int score = 128*((int) (age - getHashAge(node->slots[i].data)))
+            + depth - getHashDepth(node->slots[i].data);
+        if (score > bestScore) {
+            toReplace = &(node->slots[i]);
+            bestScore = score;
+        }
     }
+
+    // The node must be from a newer search space or be a
+    // higher depth if from the same search space.
+    if (bestScore >= -2)
+        toReplace->setEntry(b, data);
 }
 
 // Get the hash entry, if any, associated with a board b.
 uint64_t Hash::get(Board &b) {
+    PROFILE_SCOPE(PROFILE_TT_PROBE);
     uint64_t h = b.getZobristKey();
     uint64_t index = h & (size-1);
     HashNode *node = table + index;
 
-    if ((node->slot1.zobristKey ^ node->slot1.data) == b.getZobristKey())
-        return node->slot1.data;
-    else if ((node->slot2.zobristKey ^ node->slot2.data) == b.getZobristKey())
-        return node->slot2.data;
+    for (int i = 0; i < NUM_HASH_SLOTS; i++) {
+        if ((node->slots[i].zobristKey ^ node->slots[i].data) == h)
+            return node->slots[i].data;
+    }
 
     return 0;
 }
 
 uint64_t Hash::getSize() {
-    return (2 * size);
+    return (NUM_HASH_SLOTS * size);
 }
 
-void Hash::setSize(uint64_t MB) {
-    free(table);
-    init(MB);
+void Hash::setSize(uint64_t MB, int threads) {
+    release();
+    init(MB, threads);
 }
 
-void Hash::init(uint64_t MB) {
+void Hash::init(uint64_t MB, int threads) {
     // Convert to bytes
     uint64_t bytes = MB << 20;
     // Calculate how many array slots we can use
@@ -121,21 +131,100 @@ void Hash::init(uint64_t MB) {
         size <<= 1;
     size >>= 1;
 
-    table = (HashNode *) calloc(size,  sizeof(HashNode));
+    table = (HashNode *) allocateTable(size * sizeof(HashNode));
+    mapping = nullptr;
+    mappingSize = 0;
+    clear(threads);
 }
 
-void Hash::clear() {
-    std::memset(table, 0, size * sizeof(HashNode));
+// Frees the table, or unmaps it if it was loaded from a file
+void Hash::release() {
+#if !defined(_WIN32)
+    if (mapping != nullptr) {
+        munmap(mapping, mappingSize);
+        return;
+    }
+#endif
+    freeTable(table);
 }
 
+// Clears the table, splitting the work over the given number of threads
+void Hash::clear(int threads) {
+    clearTable(table, size * sizeof(HashNode), threads);
+}
+
+// Samples the first 5000 entries to estimate how full the table is
 int Hash::estimateHashfull(uint8_t age) {
     
     int i, used = 0;
     
-    for (i = 0; i < 2500 && i < (int64_t)size; i++) {
-        used += getHashAge((table + i)->slot1.data) == age;
-        used += getHashAge((table + i)->slot2.data) == age;
+    for (i = 0; i < 5000 / NUM_HASH_SLOTS && i < (int64_t)size; i++) {
+        for (int j = 0; j < NUM_HASH_SLOTS; j++)
+            used += getHashAge((table + i)->slots[j].data) == age;
     }
     
-    return 1000 * used / (i * 2);
+    return 1000 * used / (i * NUM_HASH_SLOTS);
+}
+
+/*
+ * Writes the table to a file: a header with a magic number and the number of
+ * nodes, padded to HASH_FILE_HEADER_SIZE bytes, followed by the nodes as they
+ * are in memory. Entry ages are stored in the entries themselves.
+ */
+bool Hash::save(const std::string &path) {
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    uint64_t header[HASH_FILE_HEADER_SIZE / sizeof(uint64_t)] = {};
+    header[0] = HASH_FILE_MAGIC;
+    header[1] = size;
+    bool success = fwrite(header, sizeof(header), 1, file) == 1
+                && fwrite(table, sizeof(HashNode), size, file) == size;
+
+    return (fclose(file) == 0) && success;
+}
+
+/*
+ * Replaces the table with one saved by save(). The file is mapped copy-on-write,
+ * so loading costs nothing up front: pages are read in as the search touches
+ * them, and pages that are never written stay shared in the page cache with
+ * any other process using the same file. The table takes the size stored in
+ * the file.
+ */
+bool Hash::load(const std::string &path) {
+#if defined(_WIN32)
+    return false;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) != 0 || (uint64_t) statbuf.st_size < HASH_FILE_HEADER_SIZE) {
+        close(fd);
+        return false;
+    }
+    uint64_t fileSize = (uint64_t) statbuf.st_size;
+    void *data = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    // Check that the header describes a table matching the file size
+    uint64_t *header = (uint64_t *) data;
+    uint64_t nodes = header[1];
+    if (header[0] != HASH_FILE_MAGIC || nodes == 0 || (nodes & (nodes - 1))
+     || fileSize != HASH_FILE_HEADER_SIZE + nodes * sizeof(HashNode)) {
+        munmap(data, fileSize);
+        return false;
+    }
+
+    release();
+    mapping = data;
+    mappingSize = fileSize;
+    table = (HashNode *) ((char *) data + HASH_FILE_HEADER_SIZE);
+    size = nodes;
+    return true;
+#endif
 }
@@ -19,6 +19,7 @@
 #ifndef __HASH_H__
 #define __HASH_H__
 
+#include <string>
 #include "board.h"
 #include "common.h"
 
@@ -80,11 +81,18 @@ struct HashEntry {
     ~HashEntry() {}
 };
 
-// This contains each of the hash table entries, in a two-bucket system.
-class HashNode {
+const int NUM_HASH_SLOTS = 4;
+
+// Hash table files start with a header padded to this size, so that the
+// table itself can be memory mapped at a page boundary
+const uint64_t HASH_FILE_HEADER_SIZE = 4096;
+const uint64_t HASH_FILE_MAGIC = 0x315454524553414C;  // "LASERTT1"
+
+// This contains each of the hash table entries, in a four-bucket system.
+// Each node fills exactly one 64-byte cache line.
+class alignas(64) HashNode {
 public:
-    HashEntry slot1;
-    HashEntry slot2;
+    HashEntry slots[NUM_HASH_SLOTS];
 
     HashNode() {}
     ~HashNode() {}
@@ -94,8 +102,13 @@ class Hash {
 private:
     HashNode *table;
     uint64_t size;
+    // The file mapping holding the table if it was loaded from a file,
+    // otherwise nullptr
+    void *mapping;
+    uint64_t mappingSize;
 
-    void init(uint64_t MB);
+    void init(uint64_t MB, int threads);
+    void release();
 
 public:
 
@@ -106,10 +119,15 @@ public:
 
     void add(Board &b, uint64_t data, int depth, uint8_t age);
     uint64_t get(Board &b);
+    void prefetch(uint64_t key) {
+        __builtin_prefetch(table + (key & (size-1)));
+    }
     uint64_t getSize();
-    void setSize(uint64_t MB);
-    void clear();
+    void setSize(uint64_t MB, int threads);
+    void clear(int threads);
     int estimateHashfull(uint8_t age);
+    bool save(const std::string &path);
+    bool load(const std::string &path);
 };
 
 #endif
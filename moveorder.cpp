@@ -18,6 +18,7 @@
 
 #include "search.h"
 #include "moveorder.h"
+#include "profile.h"
 
 const int SCORE_IID_MOVE = (1 << 20);
 const int SCORE_WINNING_CAPTURE = (1 << 18);
@@ -28,13 +29,15 @@ const int SCORE_LOSING_CAPTURE = -(1 << 30) - (1 << 28);
 
 
 MoveOrder::MoveOrder(Board *_b, int _color, int _depth, int _threadID, bool _isPVNode,
-	bool _isCutNode, int _staticEval, int _beta, SearchParameters *_searchParams, SearchStackInfo *_ssi, Move _hashed, MoveList _legalMoves) {
+	bool _isCutNode, bool _isInCheck, int _staticEval, int _beta, SearchParameters *_searchParams, SearchStackInfo *_ssi, Move _hashed, MoveList &_legalMoves,
+	ScoreList &_scores) : legalMoves(_legalMoves), scores(_scores) {
 	b = _b;
 	color = _color;
 	depth = _depth;
     threadID = _threadID;
 	isPVNode = _isPVNode;
     isCutNode = _isCutNode;
+    isInCheck = _isInCheck;
     staticEval = _staticEval;
     beta = _beta;
 	searchParams = _searchParams;
@@ -43,35 +46,50 @@ MoveOrder::MoveOrder(Board *_b, int _color, int _depth, int _threadID, bool _isP
     quietStart = 0;
     index = 0;
     hashed = _hashed;
-    legalMoves = _legalMoves;
+    killer = NULL_MOVE;
+    allGenerated = false;
+    hasCheckInfo = false;
+    legalMoves.clear();
+    scores.clear();
 }
 
-// Returns true if there are still moves remaining, false if we have
-// generated all moves already
+// Generates and scores the moves of the next stage. Moves are generated lazily
+// so that a cutoff by the hash move, a capture, or the killer saves generating
+// the later stages.
 void MoveOrder::generateMoves() {
     switch (mgStage) {
-        // The hash move, if any, is handled separately from the rest of the list
+        // The hash move, if any, is tried before any moves are generated
         case STAGE_NONE:
             if (hashed != NULL_MOVE) {
                 mgStage = STAGE_HASH_MOVE;
-
-                // Remove the hash move from the list, since it has already been tried
-                for (unsigned int i = 0; i < legalMoves.size(); i++) {
-                    if (legalMoves.get(i) == hashed) {
-                        legalMoves.remove(i);
-                        break;
-                    }
-                }
-
                 break;
             }
             // else fallthrough
 
-        // If we just searched the hash move (or there is none), we need to find
-        // where the quiet moves start in the list, and then do IID or score captures.
-        case STAGE_HASH_MOVE:
+        // If we just searched the hash move (or there is none), generate the
+        // captures, and then do IID or score captures. IID searches every
+        // move, and check evasions are generated together, so in those cases
+        // the whole list is generated at once.
+        case STAGE_HASH_MOVE: {
+            legalityInfo = b->getLegalityInfo(color);
+            bool useIID = (hashed == NULL_MOVE && doIID());
+            if (isInCheck) {
+                b->getPseudoLegalCheckEscapes(legalMoves, color);
+                allGenerated = true;
+            }
+            else if (useIID) {
+                b->getAllPseudoLegalMoves(legalMoves, color);
+                allGenerated = true;
+            }
+            else
+                b->getPseudoLegalCaptures(legalMoves, color, true);
+
+            // The hash move has already been tried
+            if (hashed != NULL_MOVE)
+                removeMove(hashed, 0);
             findQuietStart();
-            if (hashed == NULL_MOVE && doIID()) {
+
+            if (useIID) {
                 mgStage = STAGE_IID_MOVE;
                 scoreIIDMove();
             }
@@ -80,6 +98,7 @@ void MoveOrder::generateMoves() {
                 scoreCaptures(false);
             }
             break;
+        }
 
         // After searching the IID move, we score captures
         case STAGE_IID_MOVE:
@@ -87,9 +106,34 @@ void MoveOrder::generateMoves() {
             scoreCaptures(true);
             break;
 
-        // After winnning captures, we score quiets
+        // After winning and even captures, try the killer if it is a legal
+        // quiet move in this position. It is added to the list so that it is
+        // searched next and its history can be updated like any other move.
         case STAGE_CAPTURES:
+            if (allGenerated) {
+                mgStage = STAGE_QUIETS;
+                scoreQuiets();
+                break;
+            }
+            mgStage = STAGE_KILLER;
+            killer = searchParams->killers[ssi->ply][0];
+            if (killer != hashed && b->isPseudoLegalQuiet(killer, color)) {
+                legalMoves.add(killer);
+                scores.add(SCORE_EVEN_CAPTURE - 1);
+            }
+            else
+                killer = NULL_MOVE;
+            break;
+
+        // Generate and score the remaining quiets
+        case STAGE_KILLER:
             mgStage = STAGE_QUIETS;
+            quietStart = legalMoves.size();
+            b->getPseudoLegalQuiets(legalMoves, color);
+            if (hashed != NULL_MOVE)
+                removeMove(hashed, quietStart);
+            if (killer != NULL_MOVE)
+                removeMove(killer, quietStart);
             scoreQuiets();
             break;
 
@@ -101,6 +145,7 @@ void MoveOrder::generateMoves() {
 
 // Sort captures using SEE and MVV/LVA
 void MoveOrder::scoreCaptures(bool isIIDMove) {
+    PROFILE_SCOPE(PROFILE_MOVE_SCORING);
     for (unsigned int i = isIIDMove; i < quietStart; i++) {
         Move m = legalMoves.get(i);
 
@@ -131,13 +176,12 @@ void MoveOrder::scoreCaptures(bool isIIDMove) {
                 scores.add(SCORE_EVEN_CAPTURE + b->getMVVLVAScore(color, m));
 
             // If the initial capture is losing, we need to check whether the
-            // piece was hanging using SEE
+            // piece was hanging using SEE. Only the sign matters here, so the
+            // threshold tests are enough.
             else {
-                int see = b->getSEEForMove(color, m);
-
-                if (see > 0)
+                if (b->getSEEGreaterEqual(color, m, 1))
                     scores.add(SCORE_WINNING_CAPTURE + b->getMVVLVAScore(color, m));
-                else if (see == 0)
+                else if (b->getSEEGreaterEqual(color, m, 0))
                     scores.add(SCORE_EVEN_CAPTURE + b->getMVVLVAScore(color, m));
                 else
                     scores.add(SCORE_LOSING_CAPTURE + b->getMVVLVAScore(color, m));
@@ -147,6 +191,7 @@ void MoveOrder::scoreCaptures(bool isIIDMove) {
 }
 
 void MoveOrder::scoreQuiets() {
+    PROFILE_SCOPE(PROFILE_MOVE_SCORING);
     for (unsigned int i = quietStart; i < legalMoves.size(); i++) {
         Move m = legalMoves.get(i);
 
@@ -165,9 +210,9 @@ void MoveOrder::scoreQuiets() {
             int pieceID = b->getPieceOnSquare(color, startSq);
 
             scores.add(SCORE_QUIET_MOVE
-                + searchParams->historyTable[color][pieceID][endSq]
-                + ((ssi->counterMoveHistory != nullptr) ? ssi->counterMoveHistory[pieceID][endSq] : 0)
-                + ((ssi->followupMoveHistory != nullptr) ? ssi->followupMoveHistory[pieceID][endSq] : 0));
+                + historyLoad(searchParams->history->historyTable[color][pieceID][endSq])
+                + ((ssi->counterMoveHistory != nullptr) ? historyLoad(ssi->counterMoveHistory[pieceID][endSq]) : 0)
+                + ((ssi->followupMoveHistory != nullptr) ? historyLoad(ssi->followupMoveHistory[pieceID][endSq]) : 0));
         }
     }
 }
@@ -213,45 +258,80 @@ void MoveOrder::scoreIIDMove() {
 // partial selection sort. This way, the entire list does not have to be sorted
 // if an early cutoff occurs.
 Move MoveOrder::nextMove() {
-    // Special case when we have a hash move available
-    if (mgStage == STAGE_HASH_MOVE)
-        return hashed;
+    // The hash move is tried before anything is generated, and the captures
+    // are only generated once it has been searched without a cutoff
+    if (mgStage == STAGE_NONE) {
+        generateMoves();
+        if (mgStage == STAGE_HASH_MOVE)
+            return hashed;
+    }
+    else if (mgStage == STAGE_HASH_MOVE)
+        generateMoves();
     if (mgStage == STAGE_IID_MOVE) {
         generateMoves();
         index++;
         return legalMoves.get(0);
     }
 
-    // If we are the end of our generated list, generate more.
-    // If there are no moves left, return NULL_MOVE to indicate so.
-    while (index >= scores.size()) {
-        if (mgStage == STAGE_QUIETS)
-            return NULL_MOVE;
-        else {
-            generateMoves();
+    while (true) {
+        // If we are the end of our generated list, generate more.
+        // If there are no moves left, return NULL_MOVE to indicate so.
+        while (index >= scores.size()) {
+            if (mgStage == STAGE_QUIETS)
+                return NULL_MOVE;
+            else {
+                generateMoves();
+            }
         }
-    }
 
-    // Find the index of the next best move
-    int bestIndex = index;
-    int bestScore = scores.get(index);
-    for (unsigned int i = index + 1; i < scores.size(); i++) {
-        if (scores.get(i) > bestScore) {
-            bestIndex = i;
-            bestScore = scores.get(bestIndex);
+        // Find the index of the next best move
+        int bestIndex = index;
+        int bestScore = scores.get(index);
+        for (unsigned int i = index + 1; i < scores.size(); i++) {
+            if (scores.get(i) > bestScore) {
+                bestIndex = i;
+                bestScore = scores.get(bestIndex);
+            }
         }
-    }
 
-    // Swap the best move to the correct position
-    legalMoves.swap(bestIndex, index);
-    scores.swap(bestIndex, index);
+        // Swap the best move to the correct position
+        legalMoves.swap(bestIndex, index);
+        scores.swap(bestIndex, index);
 
-    // Once we've gotten to even captures, we need to generate quiets since
-    // some quiets (killers, promotions) should be searched first.
-    if (mgStage == STAGE_CAPTURES && bestScore < SCORE_WINNING_CAPTURE)
-        generateMoves();
+        // Once we've gotten to even captures, we need to score quiets since
+        // some quiets (killers, promotions) should be searched first.
+        if (mgStage == STAGE_CAPTURES && allGenerated && bestScore < SCORE_WINNING_CAPTURE)
+            generateMoves();
+        // When generating in stages, the killer comes after the even captures
+        // and the quiets come after the killer
+        else if ((mgStage == STAGE_CAPTURES && bestScore < SCORE_EVEN_CAPTURE)
+              || (mgStage == STAGE_KILLER && bestScore < SCORE_EVEN_CAPTURE - 1)) {
+            generateMoves();
+            continue;
+        }
 
-    return legalMoves.get(index++);
+        // Illegal moves are skipped here so that they are never made
+        Move m = legalMoves.get(index++);
+        if (b->isLegalMove(m, color, legalityInfo))
+            return m;
+    }
+}
+
+// Tests whether a move gives check. The check squares are only computed once
+// per node.
+bool MoveOrder::isCheckMove(Move m) {
+    if (!hasCheckInfo) {
+        checkInfo = b->getCheckInfo(color);
+        hasCheckInfo = true;
+    }
+    return b->isCheckMove(color, m, checkInfo);
+}
+
+// Decays a history score towards zero and adds a bonus (or penalty)
+static inline void updateHistoryScore(HistoryScore &h, int histDepth, int bonus) {
+    int value = historyLoad(h);
+    value -= histDepth * value / 64;
+    historyStore(h, value + bonus);
 }
 
 // When a PV or cut move is found, the history of the best move in increased,
@@ -260,22 +340,7 @@ void MoveOrder::updateHistories(Move bestMove) {
     int histDepth = std::min(depth, 12);
 
     // Increase history for the best move
-    int startSq = getStartSq(bestMove);
-    int endSq = getEndSq(bestMove);
-    int pieceID = b->getPieceOnSquare(color, startSq);
-    searchParams->historyTable[color][pieceID][endSq] -=
-        histDepth * searchParams->historyTable[color][pieceID][endSq] / 64;
-    searchParams->historyTable[color][pieceID][endSq] += histDepth * histDepth;
-    if (ssi->counterMoveHistory != nullptr) {
-        ssi->counterMoveHistory[pieceID][endSq] -=
-            histDepth * ssi->counterMoveHistory[pieceID][endSq] / 64;
-        ssi->counterMoveHistory[pieceID][endSq] += histDepth * histDepth;
-    }
-    if (ssi->followupMoveHistory != nullptr) {
-        ssi->followupMoveHistory[pieceID][endSq] -=
-            histDepth * ssi->followupMoveHistory[pieceID][endSq] / 64;
-        ssi->followupMoveHistory[pieceID][endSq] += histDepth * histDepth;
-    }
+    updateHistory(bestMove, histDepth, histDepth * histDepth);
 
     // If we searched only the hash move, return to prevent crashes
     if (index <= 0)
@@ -285,23 +350,43 @@ void MoveOrder::updateHistories(Move bestMove) {
             break;
         if (isCapture(legalMoves.get(i)))
             continue;
+        updateHistory(legalMoves.get(i), histDepth, -histDepth * histDepth);
+    }
+}
 
-        startSq = getStartSq(legalMoves.get(i));
-        endSq = getEndSq(legalMoves.get(i));
-        pieceID = b->getPieceOnSquare(color, startSq);
-
-        searchParams->historyTable[color][pieceID][endSq] -=
-            histDepth * searchParams->historyTable[color][pieceID][endSq] / 64;
-        searchParams->historyTable[color][pieceID][endSq] -= histDepth * histDepth;
-        if (ssi->counterMoveHistory != nullptr) {
-            ssi->counterMoveHistory[pieceID][endSq] -=
-                histDepth * ssi->counterMoveHistory[pieceID][endSq] / 64;
-            ssi->counterMoveHistory[pieceID][endSq] -= histDepth * histDepth;
-        }
-        if (ssi->followupMoveHistory != nullptr) {
-            ssi->followupMoveHistory[pieceID][endSq] -=
-                histDepth * ssi->followupMoveHistory[pieceID][endSq] / 64;
-            ssi->followupMoveHistory[pieceID][endSq] -= histDepth * histDepth;
+// ABDADA: a deferred best move is searched after the move sorter has run out
+// of moves, so its position in the move list says nothing about which moves
+// were searched before it. The quiet moves searched at the node are given
+// instead.
+void MoveOrder::updateHistories(Move bestMove, MoveList &searchedQuiets) {
+    int histDepth = std::min(depth, 12);
+
+    updateHistory(bestMove, histDepth, histDepth * histDepth);
+    for (unsigned int i = 0; i < searchedQuiets.size(); i++) {
+        if (searchedQuiets.get(i) != bestMove)
+            updateHistory(searchedQuiets.get(i), histDepth, -histDepth * histDepth);
+    }
+}
+
+// Updates the history and continuation histories of a quiet move
+void MoveOrder::updateHistory(Move m, int histDepth, int bonus) {
+    int startSq = getStartSq(m);
+    int endSq = getEndSq(m);
+    int pieceID = b->getPieceOnSquare(color, startSq);
+
+    updateHistoryScore(searchParams->history->historyTable[color][pieceID][endSq], histDepth, bonus);
+    if (ssi->counterMoveHistory != nullptr)
+        updateHistoryScore(ssi->counterMoveHistory[pieceID][endSq], histDepth, bonus);
+    if (ssi->followupMoveHistory != nullptr)
+        updateHistoryScore(ssi->followupMoveHistory[pieceID][endSq], histDepth, bonus);
+}
+
+// Removes a move that was already tried from the list, searching from start
+void MoveOrder::removeMove(Move m, unsigned int start) {
+    for (unsigned int i = start; i < legalMoves.size(); i++) {
+        if (legalMoves.get(i) == m) {
+            legalMoves.remove(i);
+            return;
         }
     }
 }
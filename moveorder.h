@@ -25,7 +25,8 @@
 #include "searchparams.h"
 
 enum MoveGenStage {
-    STAGE_NONE, STAGE_HASH_MOVE, STAGE_IID_MOVE, STAGE_CAPTURES, STAGE_QUIETS
+    STAGE_NONE, STAGE_HASH_MOVE, STAGE_IID_MOVE, STAGE_CAPTURES, STAGE_KILLER,
+    STAGE_QUIETS
 };
 
 struct MoveOrder {
@@ -35,31 +36,49 @@ struct MoveOrder {
     int threadID;
 	bool isPVNode;
     bool isCutNode;
+    bool isInCheck;
     int staticEval;
     int beta;
 	SearchParameters *searchParams;
     SearchStackInfo *ssi;
     MoveGenStage mgStage;
     Move hashed;
-	MoveList legalMoves;
-	ScoreList scores;
+    // The killer tried before quiets are generated, if it is legal here
+    Move killer;
+	// The move list and the scores are the per-ply buffers of the search,
+	// and are sorted in place
+	MoveList &legalMoves;
+	ScoreList &scores;
+    // Pins and checks for legality testing, set up once the hash move is done
+    LegalityInfo legalityInfo;
+    // Check squares for finding checking moves, computed when first needed
+    CheckInfo checkInfo;
+    bool hasCheckInfo;
     unsigned int quietStart;
 	unsigned int index;
+    // Whether the whole move list was generated at once, which is done for
+    // check evasions and for IID
+    bool allGenerated;
 
 	MoveOrder(Board *_b, int _color, int _depth, int _threadID, bool _isPVNode,
-		bool _isCutNode, int _staticEval, int _beta, SearchParameters *_searchParams, SearchStackInfo *_ssi, Move _hashed, MoveList _legalMoves);
+		bool _isCutNode, bool _isInCheck, int _staticEval, int _beta, SearchParameters *_searchParams, SearchStackInfo *_ssi, Move _hashed, MoveList &_legalMoves,
+		ScoreList &_scores);
 
     bool doIID();
 
 	void generateMoves();
 	Move nextMove();
+    bool isCheckMove(Move m);
     void updateHistories(Move bestMove);
+    void updateHistories(Move bestMove, MoveList &searchedQuiets);
 
 private:
+    void updateHistory(Move m, int histDepth, int bonus);
     void scoreCaptures(bool isIIDMove);
     void scoreQuiets();
     void scoreIIDMove();
     void findQuietStart();
+    void removeMove(Move m, unsigned int start);
 };
 
 #endif
\ No newline at end of file
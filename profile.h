@@ -0,0 +1,113 @@
+/*
+    Laser, a UCI chess engine written in C++11.
+    Copyright 2015-2018 Jeffrey An and Michael An
+
+    Laser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Laser is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Laser.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <cstdint>
+
+/*
+ * Hot path instrumentation, compiled in only by "make profile", which defines
+ * LASER_PROFILE. In a normal build PROFILE_SCOPE expands to nothing.
+ *
+ * A PROFILE_SCOPE adds the cycles spent until the end of the enclosing block
+ * to its counter. Timers of different subsystems nest, so a subsystem's time
+ * includes the subsystems it calls (e.g. move scoring includes SEE), while a
+ * subsystem re-entering itself is only counted once.
+ */
+enum ProfileCounter {
+    PROFILE_SEARCH, PROFILE_EVAL, PROFILE_MOVEGEN, PROFILE_MOVE_SCORING,
+    PROFILE_TT_PROBE, PROFILE_TT_STORE, PROFILE_SEE, PROFILE_TB_PROBE,
+    NUM_PROFILE_COUNTERS
+};
+
+const char * const PROFILE_COUNTER_NAMES[NUM_PROFILE_COUNTERS] = {
+    "Search", "Evaluate", "Move generation", "Move scoring",
+    "TT probe", "TT store", "SEE", "Syzygy probe"
+};
+
+// Per-thread profiling results, kept in each thread's ThreadMemory
+struct ProfileData {
+    uint64_t cycles[NUM_PROFILE_COUNTERS];
+    uint64_t calls[NUM_PROFILE_COUNTERS];
+    int active[NUM_PROFILE_COUNTERS];
+
+    ProfileData() {
+        clear();
+    }
+
+    void clear() {
+        for (int i = 0; i < NUM_PROFILE_COUNTERS; i++) {
+            cycles[i] = 0;
+            calls[i] = 0;
+            active[i] = 0;
+        }
+    }
+};
+
+#ifdef LASER_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline uint64_t readCycleCounter() {
+    return __rdtsc();
+}
+#else
+#include <chrono>
+inline uint64_t readCycleCounter() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+// The profile of the search thread running on this thread, or nullptr
+// outside of search (e.g. perft), in which case nothing is recorded
+extern thread_local ProfileData *threadProfile;
+
+class ProfileTimer {
+private:
+    ProfileData *profile;
+    ProfileCounter counter;
+    uint64_t start;
+
+public:
+    ProfileTimer(ProfileCounter c) : profile(threadProfile), counter(c) {
+        if (profile != nullptr && profile->active[counter]++ == 0)
+            start = readCycleCounter();
+    }
+
+    ~ProfileTimer() {
+        if (profile != nullptr && --profile->active[counter] == 0) {
+            profile->cycles[counter] += readCycleCounter() - start;
+            profile->calls[counter]++;
+        }
+    }
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(counter) \
+    ProfileTimer PROFILE_CONCAT(profileTimer, __LINE__)(counter)
+
+#else
+
+#define PROFILE_SCOPE(counter)
+
+#endif
+
+#endif
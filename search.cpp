@@ -19,9 +19,11 @@
 #include <algorithm>
 #include <atomic>
 #include <cmath>
+#include <condition_variable>
 #include <iomanip>
 #include <iostream>
 #include <mutex>
+#include <sstream>
 #include <thread>
 #include <vector>
 #include "eval.h"
@@ -29,12 +31,12 @@
 #include "hash.h"
 #include "search.h"
 #include "moveorder.h"
+#include "profile.h"
 #include "searchparams.h"
 #include "timeman.h"
 #include "uci.h"
 #include "syzygy/tbprobe.h"
 
-using std::cout;
 using std::cerr;
 using std::endl;
 
@@ -49,6 +51,11 @@ struct SearchStatistics {
     uint64_t qsNodes;
     uint64_t qsFailHighs, qsFirstFailHighs;
     uint64_t evalCacheProbes, evalCacheHits;
+    uint64_t evalCacheMisses, evalCacheCollisions;
+    // Threshold SEE tests, and how many were decided before the exchange ended
+    uint64_t seeTests, seeEarlyExits;
+    // Number of qsearch evals stopping at each lazy eval stage
+    uint64_t evalTiers[EVAL_TIER_FULL+1];
 
     SearchStatistics() {
         reset();
@@ -63,6 +70,10 @@ struct SearchStatistics {
         qsNodes = 0;
         qsFailHighs = qsFirstFailHighs = 0;
         evalCacheProbes = evalCacheHits = 0;
+        evalCacheMisses = evalCacheCollisions = 0;
+        seeTests = seeEarlyExits = 0;
+        for (int i = 0; i <= EVAL_TIER_FULL; i++)
+            evalTiers[i] = 0;
     }
 };
 
@@ -81,7 +92,19 @@ struct ThreadMemory {
     SearchParameters searchParams;
     SearchStatistics searchStats;
     SearchStackInfo ssInfo[129];
+    // Move and score buffers for each ply of PVS, filled in place by
+    // MoveOrder so that move lists are never copied
+    MoveList plyMoves[129];
+    ScoreList plyScores[129];
+    // ABDADA: the moves deferred at each ply, and the quiet moves searched at
+    // each ply for history updates, only used in that mode
+    MoveList plyDeferred[129];
+    MoveList plySearchedQuiets[129];
     TwoFoldStack twoFoldPositions;
+    PawnHash pawnHash;
+#ifdef LASER_PROFILE
+    ProfileData profile;
+#endif
 
     ThreadMemory() {
         for (int i = 0; i < 129; i++)
@@ -137,24 +160,110 @@ const unsigned int LMP_MOVE_COUNTS[2][13] = {
 //-----------------------------Global variables---------------------------------
 static Hash transpositionTable(DEFAULT_HASH_SIZE);
 static EvalHash evalCache(DEFAULT_HASH_SIZE);
+// Table sizes in MB, kept so the tables can be reallocated
+static uint64_t hashSizeMB = DEFAULT_HASH_SIZE;
+static uint64_t evalCacheSizeMB = DEFAULT_HASH_SIZE;
+// Whether the hash tables may hold entries from a search or a loaded file.
+// Only tables that are still empty are reallocated when the thread count
+// changes.
+static bool tablesInUse = false;
 static std::vector<ThreadMemory *> threadMemoryArray;
+// History tables shared by all threads when the SharedHistory option is on
+static HistoryTables sharedHistory;
+static bool useSharedHistory = false;
+// How search threads are pinned to CPUs and NUMA nodes
+static ThreadBinding threadBinding = BIND_NONE;
+#ifdef LASER_PROFILE
+thread_local ProfileData *threadProfile = nullptr;
+#endif
 
 // Variables for time management
 ChessTime startTime;
 uint64_t timeLimit;
+// The node limit for the search over all threads, or UINT64_MAX for none
+static uint64_t nodeLimit;
+// Moves left for the main thread to search before it next reads the clock
+static int timeCheckCounter;
+// The last depth for which the search reported a result
+static int completedDepth;
+
+// The result of the last search, so that a search of the same position or of
+// the position after the expected reply can resume at the depth reached
+// instead of starting again from depth 1. Cleared along with the hash table,
+// which the resumed search relies on to fill in the skipped iterations.
+struct ReusableSearch {
+    bool valid;
+    // The root position, and the position after the first two PV moves
+    uint64_t rootKey;
+    uint64_t predictedKey;
+    int depth;
+    int score;
+    // The final root move ordering
+    MoveList rootMoves;
+    SearchPV pvLine;
+};
+static ReusableSearch lastSearch;
+static bool searchReuse = true;
+// How many plies below the last completed depth a reused search resumes at
+static int reuseDepthOffset = DEFAULT_REUSE_DEPTH_OFFSET;
+// The minimum time in ms between currmove and fail high/low info lines, and
+// the time the last info line was sent
+static uint64_t minInfoInterval = DEFAULT_INFO_INTERVAL;
+static uint64_t lastInfoTime;
 
 // Used to break out of the search thread if the stop command is given
 std::atomic<bool> isStop(true);
 // Additional stop signal to stop helper threads during SMP
 std::atomic<bool> stopSignal(true);
-// Used to ensure all threads have terminated
-std::atomic<int> threadsRunning;
-std::mutex threadsRunningMutex;
+
+// The root search handed to the lazy SMP helper threads
+struct HelperSearch {
+    Board *b;
+    MoveList *legalMoves;
+    int depth;
+    int alpha, beta;
+    unsigned int startMove;
+};
+
+// Helper threads are created once by setNumThreads() and sleep on a condition
+// variable until the main thread hands them a new root search.
+static std::vector<std::thread> helperThreads;
+static HelperSearch helperSearch;
+// Incremented each time a new root search is started on the helper threads
+static uint64_t helperSearchID = 0;
+static bool helpersExit = false;
+// Number of helper threads still searching. Protected by helperMutex
+static int threadsRunning = 0;
+// Number of helper threads that have started and set up their memory.
+// Protected by helperMutex
+static int helpersStarted = 0;
+std::mutex helperMutex;
+std::condition_variable helperStartCV;
+std::condition_variable helperDoneCV;
 
 // Dummy variables for lazy SMP since we don't care about these results
 int dummyBestIndex[MAX_THREADS-1];
 int dummyBestScore[MAX_THREADS-1];
 
+// The deepest root search completed by a helper thread during this search,
+// which can be deeper than the main thread got. Protected by helperMutex
+struct HelperResult {
+    int depth;
+    Move move;
+    int score;
+};
+static HelperResult helperResult;
+
+static SMPMode smpMode = SMP_LAZY;
+// ABDADA: moves being searched by some thread, indexed by a hash of the
+// position and move. Each entry holds the upper bits of the hash as a tag and
+// the number of threads searching the move in its low byte. Moves are only
+// marked at this depth and up so that the table is not thrashed.
+const int SEARCHING_TABLE_BITS = 15;
+const uint32_t SEARCHING_COUNT_MASK = 0xFF;
+const int ABDADA_DEFER_DEPTH = 3;
+static std::atomic<uint32_t> searchingMoves[1 << SEARCHING_TABLE_BITS];
+
 // Values for UCI options
 unsigned int multiPV;
 int numThreads;
@@ -166,6 +275,7 @@ static int probeLimit = 0;
 
 
 // Search functions
+void helperThreadLoop(int threadID);
 void getBestMoveAtDepth(Board *b, MoveList *legalMoves, int depth, int alpha,
     int beta, int *bestMoveIndex, int *bestScore, unsigned int startMove,
     int threadID, SearchPV *pvLine);
@@ -177,8 +287,16 @@ int quiescence(Board &b, int plies, int alpha, int beta, int threadID);
 int checkQuiescence(Board &b, int plies, int alpha, int beta, int threadID);
 
 // Search helpers
+int getReuseDepth(Board *b, MoveList &legalMoves, int &score, Move &ponder);
+void saveSearch(Board *b, MoveList &legalMoves, SearchPV &pvLine, int depth, int score);
+uint64_t getSearchingKey(Board &b, Move m);
+bool isSearchedElsewhere(uint64_t moveKey);
+void startSearching(uint64_t moveKey);
+void finishSearching(uint64_t moveKey);
+std::string scoreToString(int score, bool tbProbeSuccess, int tbScore);
 int scoreMate(bool isInCheck, int plies);
 int adjustHashScore(int score, int plies);
+bool seeGreaterEqual(Board &b, int color, Move m, int threshold, SearchStatistics *searchStats);
 
 // Other utility functions
 Move nextMove(MoveList &moves, ScoreList &scores, unsigned int index);
@@ -187,7 +305,9 @@ void changePV(Move best, SearchPV *parent, SearchPV *child);
 std::string retrievePV(SearchPV *pvLine);
 int getSelectiveDepth();
 double getPercentage(uint64_t numerator, uint64_t denominator);
+SearchStatistics aggregateStatistics();
 void printStatistics();
+bool isInfoDue(uint64_t timeSoFar);
 
 
 // Finds a best move for a position according to the given search parameters.
@@ -198,6 +318,9 @@ void getBestMove(Board *b, TimeManagement *timeParams, MoveList *movesToSearch)
         threadMemoryArray[i]->searchParams.rootMoveNumber = (uint8_t) (b->getMoveNumber());
         threadMemoryArray[i]->searchParams.selectiveDepth = 0;
     }
+    completedDepth = 0;
+    lastInfoTime = 0;
+    helperResult.depth = 0;
 
     int color = b->getPlayerToMove();
     MoveList legalMoves = b->getAllLegalMoves(color);
@@ -207,17 +330,32 @@ void getBestMove(Board *b, TimeManagement *timeParams, MoveList *movesToSearch)
     if (legalMoves.size() <= 0) {
         stopSignal = true;
         isStop = true;
-        cout << "bestmove none" << endl;
+        sendOutput("bestmove none");
         return;
     }
 
     Move bestMove = legalMoves.get(0);
+    tablesInUse = true;
+
+#ifdef LASER_PROFILE
+    // Only record into the main thread's profile while searching, since
+    // getBestMove may be called on a thread that does other work
+    threadProfile = &(threadMemoryArray[0]->profile);
+#endif
+
+    // The main search thread is pinned like the helpers while it searches. It
+    // is released afterwards since bench searches on the UCI thread, whose
+    // affinity helper threads and table clearing threads would inherit.
+    if (threadBinding != BIND_NONE)
+        bindThisThread(0, threadBinding);
 
     // Set up timing
     timeLimit = (timeParams->searchMode == TIME) ? timeParams->maxAllotment
                                                  : (timeParams->searchMode == MOVETIME) ? timeParams->allotment
                                                                                         : MAX_TIME;
+    nodeLimit = (timeParams->searchMode == NODES) ? timeParams->nodes : UINT64_MAX;
     startTime = ChessClock::now();
+    timeCheckCounter = (nodeLimit != UINT64_MAX) ? NODE_CHECK_INTERVAL : TIME_CHECK_INTERVAL;
     uint64_t timeSoFar = getTimeElapsed(startTime);
 
     // Special case if there is only one legal move: use less search time,
@@ -272,10 +410,26 @@ void getBestMove(Board *b, TimeManagement *timeParams, MoveList *movesToSearch)
     }
 
 
-    int bestScore, bestMoveIndex;
+    int bestScore = 0, bestMoveIndex;
     int rootDepth = 1;
     Move prevBest = NULL_MOVE;
     int pvStreak = 0;
+    // The PV and score of the last completed iteration
+    SearchPV lastPV;
+    int lastScore = 0;
+
+    // Resume from the last search if it was of this position or of the
+    // position after the expected reply. Depth and node limited searches
+    // always start from depth 1 so that their output is reproducible.
+    if (searchReuse && multiPV == 1 && movesToSearch->size() == 0
+     && timeParams->searchMode != DEPTH && timeParams->searchMode != NODES) {
+        int reuseDepth = getReuseDepth(b, legalMoves, bestScore, ponder);
+        if (reuseDepth > 0) {
+            rootDepth = std::max(reuseDepth, 1);
+            completedDepth = rootDepth - 1;
+            bestMove = legalMoves.get(0);
+        }
+    }
 
     // Iterative deepening loop
     do {
@@ -308,24 +462,28 @@ void getBestMove(Board *b, TimeManagement *timeParams, MoveList *movesToSearch)
                 for (int i = 0; i < numThreads; i++)
                     threadMemoryArray[i]->searchParams.reset();
                 pvLine.pvLength = 0;
-                threadsRunning = numThreads-1;
 
                 // Get the index of the best move
-                // If depth >= 7 create threads for SMP
+                // If depth >= 7 wake up the helper threads for SMP
                 if (rootDepth >= 7 && numThreads > 1) {
-                    std::thread *threadPool = new std::thread[numThreads-1];
-
-                    // Start secondary threads at various depths according to array SMP_DEPTHS
-                    for (int i = 1; i < numThreads; i++) {
-                        // Copy over the two-fold stack to use
+                    // Copy over the two-fold stack to use
+                    for (int i = 1; i < numThreads; i++)
                         threadMemoryArray[i]->twoFoldPositions = threadMemoryArray[0]->twoFoldPositions;
-                        threadPool[i-1] = std::thread(getBestMoveAtDepthHelper, b,
-                            &legalMoves, rootDepth + SMP_DEPTHS[i % 16], aspAlpha, aspBeta,
-                            dummyBestIndex+i-1, dummyBestScore+i-1,
-                            multiPVNum-1, i, nullptr);
-                        // Detach secondary threads
-                        threadPool[i-1].detach();
+
+                    // Secondary threads search at various depths according to
+                    // array SMP_DEPTHS
+                    {
+                        std::lock_guard<std::mutex> lock(helperMutex);
+                        helperSearch.b = b;
+                        helperSearch.legalMoves = &legalMoves;
+                        helperSearch.depth = rootDepth;
+                        helperSearch.alpha = aspAlpha;
+                        helperSearch.beta = aspBeta;
+                        helperSearch.startMove = multiPVNum-1;
+                        threadsRunning = numThreads-1;
+                        helperSearchID++;
                     }
+                    helperStartCV.notify_all();
 
                     // Start the primary result thread
                     getBestMoveAtDepth(b, &legalMoves, rootDepth, aspAlpha, aspBeta,
@@ -333,11 +491,11 @@ void getBestMove(Board *b, TimeManagement *timeParams, MoveList *movesToSearch)
 
                     stopSignal = true;
                     // Wait for all other threads to finish
-                    while (threadsRunning > 0)
-                        std::this_thread::yield();
+                    {
+                        std::unique_lock<std::mutex> lock(helperMutex);
+                        helperDoneCV.wait(lock, [] { return threadsRunning == 0; });
+                    }
                     stopSignal = false;
-
-                    delete[] threadPool;
                 }
                 // Otherwise, just search with one thread
                 else {
@@ -357,16 +515,18 @@ void getBestMove(Board *b, TimeManagement *timeParams, MoveList *movesToSearch)
                 // Handle fail highs and fail lows
                 // Fail low: no best move found
                 if (bestMoveIndex == -1 && !isStop) {
-                    cout << "info depth " << rootDepth;
-                    cout << " seldepth " << getSelectiveDepth();
-                    cout << " score";
-                    cout << " cp " << (tbProbeSuccess ? (tbScore == 0 ? 0 : (bestScore/10 + tbScore)) : bestScore) * 100 / PIECE_VALUES[EG][PAWNS] << " upperbound";
-
-                    cout << " time " << timeSoFar
-                         << " nodes " << getNodes() << " nps " << nps
-                         << " tbhits " << getTBHits()
-                         << " hashfull " << transpositionTable.estimateHashfull(threadMemoryArray[0]->searchParams.rootMoveNumber)
-                         << " pv " << pvStr << endl;
+                    if (isInfoDue(timeSoFar)) {
+                        std::ostringstream info;
+                        info << "info depth " << rootDepth;
+                        info << " seldepth " << getSelectiveDepth();
+                        info << " score";
+                        info << " cp " << (tbProbeSuccess ? (tbScore == 0 ? 0 : (bestScore/10 + tbScore)) : bestScore) * 100 / PIECE_VALUES[EG][PAWNS] << " upperbound";
+
+                        info << " time " << timeSoFar
+                             << " nodes " << getNodes() << " nps " << nps
+                             << " tbhits " << getTBHits();
+                        sendInfo(info.str(), threadMemoryArray[0]->searchParams.rootMoveNumber, " pv " + pvStr);
+                    }
 
                     aspAlpha = bestScore - deltaAlpha;
                     deltaAlpha *= 2;
@@ -375,16 +535,18 @@ void getBestMove(Board *b, TimeManagement *timeParams, MoveList *movesToSearch)
                 }
                 // Fail high: best score is at least beta
                 else if (bestScore >= aspBeta) {
-                    cout << "info depth " << rootDepth;
-                    cout << " seldepth " << getSelectiveDepth();
-                    cout << " score";
-                    cout << " cp " << (tbProbeSuccess ? (tbScore == 0 ? 0 : (bestScore/10 + tbScore)) : bestScore) * 100 / PIECE_VALUES[EG][PAWNS] << " lowerbound";
-
-                    cout << " time " << timeSoFar
-                         << " nodes " << getNodes() << " nps " << nps
-                         << " tbhits " << getTBHits()
-                         << " hashfull " << transpositionTable.estimateHashfull(threadMemoryArray[0]->searchParams.rootMoveNumber)
-                         << " pv " << pvStr << endl;
+                    if (isInfoDue(timeSoFar)) {
+                        std::ostringstream info;
+                        info << "info depth " << rootDepth;
+                        info << " seldepth " << getSelectiveDepth();
+                        info << " score";
+                        info << " cp " << (tbProbeSuccess ? (tbScore == 0 ? 0 : (bestScore/10 + tbScore)) : bestScore) * 100 / PIECE_VALUES[EG][PAWNS] << " lowerbound";
+
+                        info << " time " << timeSoFar
+                             << " nodes " << getNodes() << " nps " << nps
+                             << " tbhits " << getTBHits();
+                        sendInfo(info.str(), threadMemoryArray[0]->searchParams.rootMoveNumber, " pv " + pvStr);
+                    }
 
                     aspBeta = bestScore + deltaBeta;
                     deltaBeta *= 2;
@@ -414,13 +576,14 @@ void getBestMove(Board *b, TimeManagement *timeParams, MoveList *movesToSearch)
 
             // If we broke out before getting any new results, end the search
             if (bestMoveIndex == -1) {
-                cout << "info depth " << rootDepth-1;
-                cout << " seldepth " << getSelectiveDepth();
-                cout << " time " << timeSoFar
+                std::ostringstream info;
+                info << "info depth " << rootDepth-1;
+                info << " seldepth " << getSelectiveDepth();
+                info << " time " << timeSoFar
                      << " nodes " << getNodes() << " nps " << nps
-                     << " tbhits " << getTBHits()
-                     << " hashfull " << transpositionTable.estimateHashfull(threadMemoryArray[0]->searchParams.rootMoveNumber)
-                     << endl;
+                     << " tbhits " << getTBHits();
+                sendInfo(info.str(), threadMemoryArray[0]->searchParams.rootMoveNumber, "");
+                lastInfoTime = timeSoFar;
                 break;
             }
 
@@ -429,30 +592,20 @@ void getBestMove(Board *b, TimeManagement *timeParams, MoveList *movesToSearch)
             bestMove = legalMoves.get(0);
 
             // Output info using UCI protocol
-            cout << "info depth " << rootDepth;
-            cout << " seldepth " << getSelectiveDepth();
+            std::ostringstream info;
+            info << "info depth " << rootDepth;
+            info << " seldepth " << getSelectiveDepth();
             if (multiPV > 1)
-                cout << " multipv " << multiPVNum;
-            cout << " score";
-
-            // Print score in mate or centipawns
-            if (bestScore >= MAX_PLY_MATE_SCORE)
-                // If it is our mate, it takes plies / 2 + 1 moves to mate since
-                // our move ends the game
-                cout << " mate " << (MATE_SCORE - bestScore) / 2 + 1;
-            else if (bestScore <= -MAX_PLY_MATE_SCORE)
-                // If we are being mated, it takes plies / 2 moves since our
-                // opponent's move ends the game
-                cout << " mate " << (-MATE_SCORE - bestScore) / 2;
-            else
-                // Scale score into centipawns using our internal pawn value
-                cout << " cp " << (tbProbeSuccess ? (tbScore == 0 ? 0 : (bestScore/10 + tbScore)) : bestScore) * 100 / PIECE_VALUES[EG][PAWNS];
-
-            cout << " time " << timeSoFar
+                info << " multipv " << multiPVNum;
+            info << " score " << scoreToString(bestScore, tbProbeSuccess, tbScore);
+            info << " time " << timeSoFar
                  << " nodes " << getNodes() << " nps " << nps
-                 << " tbhits " << getTBHits()
-                 << " hashfull " << transpositionTable.estimateHashfull(threadMemoryArray[0]->searchParams.rootMoveNumber)
-                 << " pv " << pvStr << endl;
+                 << " tbhits " << getTBHits();
+            sendInfo(info.str(), threadMemoryArray[0]->searchParams.rootMoveNumber, " pv " + pvStr);
+            lastInfoTime = timeSoFar;
+            completedDepth = rootDepth;
+            lastPV = pvLine;
+            lastScore = bestScore;
         }
         // End multiPV loop
 
@@ -491,21 +644,60 @@ void getBestMove(Board *b, TimeManagement *timeParams, MoveList *movesToSearch)
         && ((((timeParams->searchMode == TIME && timeSoFar < (uint64_t) timeParams->allotment * TIME_FACTOR)
             || isPonderSearch) && rootDepth <= MAX_DEPTH)
          || (timeParams->searchMode == MOVETIME && timeSoFar < (uint64_t) timeParams->allotment && rootDepth <= MAX_DEPTH)
-         || (timeParams->searchMode == DEPTH && rootDepth <= timeParams->allotment)));
+         || (timeParams->searchMode == DEPTH && rootDepth <= timeParams->allotment)
+         || (timeParams->searchMode == NODES && getNodes() < nodeLimit && rootDepth <= MAX_DEPTH)));
 
     // When pondering, we must continue "searching" until given a stop or ponderhit command.
     while (isPonderSearch && !isStop)
         std::this_thread::sleep_for(std::chrono::milliseconds(50));
 
+    // The depth that lastPV and lastScore were found at
+    int mainThreadDepth = completedDepth;
+
+    // With ABDADA, a helper thread may have finished a deeper search than the
+    // main thread did, in which case its move is more reliable
+    if (smpMode == SMP_ABDADA && multiPV == 1) {
+        std::lock_guard<std::mutex> lock(helperMutex);
+        if (helperResult.depth > completedDepth) {
+            if (helperResult.move != bestMove) {
+                bestMove = helperResult.move;
+                ponder = NULL_MOVE;
+            }
+            completedDepth = helperResult.depth;
+
+            timeSoFar = getTimeElapsed(startTime);
+            std::ostringstream info;
+            info << "info depth " << helperResult.depth;
+            info << " score " << scoreToString(helperResult.score, tbProbeSuccess, tbScore);
+            info << " time " << timeSoFar
+                 << " nodes " << getNodes() << " nps " << 1000 * getNodes() / (timeSoFar + 1)
+                 << " tbhits " << getTBHits();
+            sendInfo(info.str(), threadMemoryArray[0]->searchParams.rootMoveNumber,
+                " pv " + moveToString(bestMove));
+        }
+    }
+
+    if (multiPV == 1 && movesToSearch->size() == 0 && lastPV.pvLength > 0
+     && lastPV.pv[0] == bestMove)
+        saveSearch(b, legalMoves, lastPV, mainThreadDepth, lastScore);
+    else
+        lastSearch.valid = false;
+
+    if (threadBinding != BIND_NONE)
+        bindThisThread(0, BIND_NONE);
+
     printStatistics();
+#ifdef LASER_PROFILE
+    threadProfile = nullptr;
+#endif
 
     // Output best move to UCI interface
     stopSignal = true;
     isStop = true;
     if (ponder != NULL_MOVE)
-        cout << "bestmove " << moveToString(bestMove) << " ponder " << moveToString(ponder) << endl;
+        sendOutput("bestmove " + moveToString(bestMove) + " ponder " + moveToString(ponder));
     else
-        cout << "bestmove " << moveToString(bestMove) << endl;
+        sendOutput("bestmove " + moveToString(bestMove));
     return;
 }
 
@@ -515,13 +707,63 @@ void getBestMoveAtDepthHelper(Board *b, MoveList *legalMoves, int depth, int alp
     while (depth <= MAX_DEPTH && !stopSignal) {
         getBestMoveAtDepth(b, legalMoves, depth, alpha, beta,
                            bestMoveIndex, bestScore, startMove, threadID, pvLine);
+
+        // Keep the deepest exact result of a finished root search so that
+        // the main thread can use it
+        if (smpMode == SMP_ABDADA && !stopSignal && startMove == 0 && *bestMoveIndex >= 0
+         && alpha < *bestScore && *bestScore < beta) {
+            std::lock_guard<std::mutex> lock(helperMutex);
+            if (depth > helperResult.depth) {
+                helperResult.depth = depth;
+                helperResult.move = legalMoves->get(*bestMoveIndex);
+                helperResult.score = *bestScore;
+            }
+        }
         depth++;
     }
+}
 
-    // This thread is finished running.
-    threadsRunningMutex.lock();
-    threadsRunning--;
-    threadsRunningMutex.unlock();
+// The main loop for a lazy SMP helper thread. The thread sleeps until it is
+// given a root search, and reports back when it has finished searching.
+void helperThreadLoop(int threadID) {
+    // With thread binding, the helper allocates its own memory once it is
+    // pinned, so that the memory is first touched on the helper's NUMA node
+    bindThisThread(threadID, threadBinding);
+    ThreadMemory *memory = nullptr;
+    if (threadMemoryArray[threadID] == nullptr)
+        memory = new ThreadMemory();
+
+    std::unique_lock<std::mutex> lock(helperMutex);
+    if (memory != nullptr)
+        threadMemoryArray[threadID] = memory;
+    helpersStarted++;
+    helperDoneCV.notify_one();
+    uint64_t lastSearchID = helperSearchID;
+#ifdef LASER_PROFILE
+    threadProfile = &(threadMemoryArray[threadID]->profile);
+#endif
+
+    while (true) {
+        helperStartCV.wait(lock, [&] { return helpersExit || helperSearchID != lastSearchID; });
+        if (helpersExit)
+            break;
+        lastSearchID = helperSearchID;
+        HelperSearch search = helperSearch;
+        lock.unlock();
+
+        // With ABDADA all threads search the same depth, dividing the tree
+        int depthOffset = (smpMode == SMP_LAZY) ? SMP_DEPTHS[threadID % 16] : 0;
+        getBestMoveAtDepthHelper(search.b, search.legalMoves,
+            search.depth + depthOffset, search.alpha, search.beta,
+            dummyBestIndex+threadID-1, dummyBestScore+threadID-1,
+            search.startMove, threadID, nullptr);
+
+        // This thread is finished running.
+        lock.lock();
+        threadsRunning--;
+        if (threadsRunning == 0)
+            helperDoneCV.notify_one();
+    }
 }
 
 /**
@@ -530,6 +772,7 @@ void getBestMoveAtDepthHelper(Board *b, MoveList *legalMoves, int depth, int alp
 void getBestMoveAtDepth(Board *b, MoveList *legalMoves, int depth, int alpha,
         int beta, int *bestMoveIndex, int *bestScore, unsigned int startMove,
         int threadID, SearchPV *pvLine) {
+    PROFILE_SCOPE(PROFILE_SEARCH);
     SearchParameters *searchParams = &(threadMemoryArray[threadID]->searchParams);
     SearchStatistics *searchStats = &(threadMemoryArray[threadID]->searchStats);
     SearchPV line;
@@ -538,43 +781,82 @@ void getBestMoveAtDepth(Board *b, MoveList *legalMoves, int depth, int alpha,
     int score = -MATE_SCORE;
     *bestScore = -INFTY;
     SearchStackInfo *ssi = &(threadMemoryArray[threadID]->ssInfo[0]);
+    // The root position is shared by all threads, so each thread makes and
+    // takes back moves on its own copy
+    Board rootBoard = b->staticCopy();
 
     // Push current position to two fold stack
     threadMemoryArray[threadID]->twoFoldPositions.push(b->getZobristKey());
 
-    // Helps prevent stalls when using more threads than physical cores,
-    // presumably by preventing this function from completing before the thread
-    // is able to detach.
-    std::this_thread::yield();
+    // ABDADA: root moves that another thread was searching are deferred until
+    // all other moves have been searched
+    bool useABDADA = (smpMode == SMP_ABDADA && numThreads > 1);
+    MoveList &deferredMoves = threadMemoryArray[threadID]->plyDeferred[ssi->ply];
+    unsigned int deferredIndex = 0;
+    if (useABDADA)
+        deferredMoves.clear();
+
+    for (unsigned int next = startMove; ; ) {
+        unsigned int i;
+        bool isDeferred = false;
+        if (next < legalMoves->size())
+            i = next++;
+        else if (useABDADA && deferredIndex < deferredMoves.size()) {
+            Move m = deferredMoves.get(deferredIndex++);
+            i = startMove;
+            while (legalMoves->get(i) != m)
+                i++;
+            isDeferred = true;
+        }
+        else
+            break;
+
+        uint64_t moveKey = 0;
+        if (useABDADA) {
+            moveKey = getSearchingKey(*b, legalMoves->get(i));
+            if (!isDeferred && i != startMove && isSearchedElsewhere(moveKey)) {
+                deferredMoves.add(legalMoves->get(i));
+                continue;
+            }
+        }
 
-    for (unsigned int i = startMove; i < legalMoves->size(); i++) {
         // Output current move info to the GUI. Only do so if 5 seconds of
         // search have elapsed to avoid clutter
-        uint64_t timeSoFar = getTimeElapsed(startTime);
-        uint64_t nps = 1000 * getNodes() / timeSoFar;
-        if (threadID == 0 && timeSoFar > 5 * ONE_SECOND)
-            cout << "info depth " << depth << " currmove " << moveToString(legalMoves->get(i))
-                 << " currmovenumber " << i+1 << " nodes " << getNodes() << " nps " << nps << endl;
+        if (threadID == 0) {
+            uint64_t timeSoFar = getTimeElapsed(startTime);
+            if (timeSoFar > 5 * ONE_SECOND && isInfoDue(timeSoFar)) {
+                uint64_t nps = 1000 * getNodes() / timeSoFar;
+                std::ostringstream info;
+                info << "info depth " << depth << " currmove " << moveToString(legalMoves->get(i))
+                     << " currmovenumber " << i+1 << " nodes " << getNodes() << " nps " << nps;
+                sendOutput(info.str());
+            }
+        }
 
-        Board copy = b->staticCopy();
-        copy.doMove(legalMoves->get(i), color);
+        UndoInfo undo;
+        rootBoard.doMove(legalMoves->get(i), color, undo);
         searchStats->nodes++;
 
         int startSq = getStartSq(legalMoves->get(i));
         int endSq = getEndSq(legalMoves->get(i));
         int pieceID = b->getPieceOnSquare(color, startSq);
-        (ssi+1)->counterMoveHistory = searchParams->counterMoveHistory[pieceID][endSq];
-        (ssi+2)->followupMoveHistory = searchParams->followupMoveHistory[pieceID][endSq];
+        (ssi+1)->counterMoveHistory = searchParams->history->counterMoveHistory[pieceID][endSq];
+        (ssi+2)->followupMoveHistory = searchParams->history->followupMoveHistory[pieceID][endSq];
 
+        if (useABDADA)
+            startSearching(moveKey);
         if (i != 0) {
-            score = -PVS(copy, depth-1, -alpha-1, -alpha, threadID, true, ssi+1, &line);
+            score = -PVS(rootBoard, depth-1, -alpha-1, -alpha, threadID, true, ssi+1, &line);
             if (alpha < score && score < beta) {
-                score = -PVS(copy, depth-1, -beta, -alpha, threadID, false, ssi+1, &line);
+                score = -PVS(rootBoard, depth-1, -beta, -alpha, threadID, false, ssi+1, &line);
             }
         }
         else {
-            score = -PVS(copy, depth-1, -beta, -alpha, threadID, false, ssi+1, &line);
+            score = -PVS(rootBoard, depth-1, -beta, -alpha, threadID, false, ssi+1, &line);
         }
+        rootBoard.undoMove(legalMoves->get(i), color, undo);
+        if (useABDADA)
+            finishSearching(moveKey);
 
         // Stop condition. If stopping, return search results from incomplete
         // search, if any.
@@ -617,26 +899,29 @@ int getBestMoveForSort(Board *b, MoveList &legalMoves, int depth, int threadID,
     threadMemoryArray[threadID]->twoFoldPositions.push(b->getZobristKey());
 
     for (unsigned int i = 0; i < legalMoves.size(); i++) {
-        Board copy = b->staticCopy();
-        if (!copy.doPseudoLegalMove(legalMoves.get(i), color))
-            continue;
-        searchStats->nodes++;
-
         int startSq = getStartSq(legalMoves.get(i));
         int endSq = getEndSq(legalMoves.get(i));
         int pieceID = b->getPieceOnSquare(color, startSq);
-        (ssi+1)->counterMoveHistory = searchParams->counterMoveHistory[pieceID][endSq];
-        (ssi+2)->followupMoveHistory = searchParams->followupMoveHistory[pieceID][endSq];
+
+        UndoInfo undo;
+        if (!b->doPseudoLegalMove(legalMoves.get(i), color, undo)) {
+            b->undoMove(legalMoves.get(i), color, undo);
+            continue;
+        }
+        searchStats->nodes++;
+        (ssi+1)->counterMoveHistory = searchParams->history->counterMoveHistory[pieceID][endSq];
+        (ssi+2)->followupMoveHistory = searchParams->history->followupMoveHistory[pieceID][endSq];
 
         if (i != 0) {
-            score = -PVS(copy, depth-1, -alpha-1, -alpha, threadID, true, ssi+1, &line);
+            score = -PVS(*b, depth-1, -alpha-1, -alpha, threadID, true, ssi+1, &line);
             if (alpha < score && score < beta) {
-                score = -PVS(copy, depth-1, -beta, -alpha, threadID, false, ssi+1, &line);
+                score = -PVS(*b, depth-1, -beta, -alpha, threadID, false, ssi+1, &line);
             }
         }
         else {
-            score = -PVS(copy, depth-1, -beta, -alpha, threadID, false, ssi+1, &line);
+            score = -PVS(*b, depth-1, -beta, -alpha, threadID, false, ssi+1, &line);
         }
+        b->undoMove(legalMoves.get(i), color, undo);
 
         // Stop condition to break out as quickly as possible
         if (stopSignal.load(std::memory_order_relaxed))
@@ -675,7 +960,7 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
     // Draw check
     if (b.isDraw())
         return 0;
-    if (threadMemoryArray[threadID]->twoFoldPositions.find(b.getZobristKey()))
+    if (threadMemoryArray[threadID]->twoFoldPositions.find(b.getZobristKey(), b.getFiftyMoveCounter()))
         return 0;
 
 
@@ -785,13 +1070,18 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
     if (!isInCheck) {
         searchStats->evalCacheProbes++;
         // Probe the eval cache for a saved evaluation
-        int ehe = evalCache.get(b);
+        EvalHashProbe probe;
+        int ehe = evalCache.get(b, probe);
         if (ehe != 0) {
             searchStats->evalCacheHits++;
             ssi->staticEval = staticEval = ehe - EVAL_HASH_OFFSET;
         }
         else {
-            Eval e;
+            if (probe == EVAL_HASH_COLLISION)
+                searchStats->evalCacheCollisions++;
+            else
+                searchStats->evalCacheMisses++;
+            Eval e(&(threadMemoryArray[threadID]->pawnHash));
             ssi->staticEval = staticEval = (color == WHITE) ? e.evaluate(b)
                                                             : -e.evaluate(b);
             evalCache.add(b, staticEval);
@@ -857,6 +1147,7 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
         int reduction = 2 + (32 * depth + std::min(staticEval - beta, 384)) / 128;
 
         uint16_t epCaptureFile = b.getEPCaptureFile();
+        threadMemoryArray[threadID]->twoFoldPositions.pushNullMove();
         b.doNullMove();
         searchParams->nullMoveCount++;
         (ssi+1)->counterMoveHistory = nullptr;
@@ -865,6 +1156,7 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
 
         // Undo the null move
         b.undoNullMove(epCaptureFile);
+        threadMemoryArray[threadID]->twoFoldPositions.pop();
         searchParams->nullMoveCount = 0;
 
         if (nullScore >= beta) {
@@ -878,16 +1170,12 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
     }
 
 
-    // Create list of legal moves
-    MoveList legalMoves;
-    if (isInCheck)
-        b.getPseudoLegalCheckEscapes(legalMoves, color);
-    else
-        b.getAllPseudoLegalMoves(legalMoves, color);
-    // Initialize the module for move ordering
+    // Initialize the module for move ordering, which generates the moves into
+    // this ply's buffer in stages
+    MoveList &legalMoves = threadMemoryArray[threadID]->plyMoves[ssi->ply];
     MoveOrder moveSorter(&b, color, depth, threadID, isPVNode,
-        isCutNode, staticEval, beta, searchParams, ssi, hashed, legalMoves);
-    moveSorter.generateMoves();
+        isCutNode, isInCheck, staticEval, beta, searchParams, ssi, hashed, legalMoves,
+        threadMemoryArray[threadID]->plyScores[ssi->ply]);
 
     // Keeps track of the best move for storing into the TT
     Move toHash = NULL_MOVE;
@@ -896,29 +1184,74 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
     int bestScore = -INFTY;
     int score = -INFTY;
 
+    // ABDADA: moves that another thread was searching are deferred until all
+    // other moves have been searched, by when their results are likely to be
+    // in the transposition table. The searched quiet moves are recorded since
+    // the move sorter's order does not show which moves preceded a deferred one.
+    bool useABDADA = (smpMode == SMP_ABDADA && numThreads > 1 && depth >= ABDADA_DEFER_DEPTH);
+    MoveList &deferredMoves = threadMemoryArray[threadID]->plyDeferred[ssi->ply];
+    MoveList &searchedQuiets = threadMemoryArray[threadID]->plySearchedQuiets[ssi->ply];
+    unsigned int deferredIndex = 0;
+    // Whether the best move so far was a deferred move
+    bool toHashDeferred = false;
+    if (useABDADA) {
+        deferredMoves.clear();
+        searchedQuiets.clear();
+    }
+
 
     //----------------------------Main search loop------------------------------
-    for (Move m = moveSorter.nextMove(); m != NULL_MOVE;
-              m = moveSorter.nextMove()) {
-        // Check for a timeout
-        if (!isPonderSearch) {
-            uint64_t timeSoFar = getTimeElapsed(startTime);
-            if (timeSoFar > timeLimit) {
-                isStop = true;
-                stopSignal = true;
+    for (Move m = moveSorter.nextMove(); ; m = moveSorter.nextMove()) {
+        bool isDeferred = false;
+        if (m == NULL_MOVE) {
+            if (!useABDADA || deferredIndex >= deferredMoves.size())
+                break;
+            m = deferredMoves.get(deferredIndex++);
+            isDeferred = true;
+        }
+
+        // Check for a timeout. Reading the clock is slow, so only the main
+        // thread does so, once every TIME_CHECK_INTERVAL moves. The stop
+        // signal it sets also stops the helper threads. Node limits are
+        // checked the same way, summing the node counts of all threads more
+        // often instead of counting nodes in a shared variable.
+        if (threadID == 0 && --timeCheckCounter <= 0) {
+            if (nodeLimit != UINT64_MAX) {
+                timeCheckCounter = NODE_CHECK_INTERVAL;
+                if (!isPonderSearch && getNodes() >= nodeLimit) {
+                    isStop = true;
+                    stopSignal = true;
+                }
+            }
+            else {
+                timeCheckCounter = TIME_CHECK_INTERVAL;
+                if (!isPonderSearch && getTimeElapsed(startTime) > timeLimit) {
+                    isStop = true;
+                    stopSignal = true;
+                }
             }
         }
         // Stop condition to help break out as quickly as possible
         if (stopSignal.load(std::memory_order_relaxed))
             return INFTY;
 
+        // The first move is never deferred, as in young brothers wait
+        uint64_t moveKey = 0;
+        if (useABDADA) {
+            moveKey = getSearchingKey(b, m);
+            if (!isDeferred && movesSearched > 0 && isSearchedElsewhere(moveKey)) {
+                deferredMoves.add(m);
+                continue;
+            }
+        }
+
         // Conditions for whether to do futility and move count pruning
         bool moveIsPrunable = !isInCheck
                            && !isCapture(m)
                            && !isPromotion(m)
                            && m != hashed
                            && bestScore > -MAX_PLY_MATE_SCORE
-                           && !b.isCheckMove(color, m);
+                           && !moveSorter.isCheckMove(m);
 
         // For accessing history tables
         int startSq = getStartSq(m);
@@ -951,8 +1284,8 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
         // Prune moves with low history
         if (moveIsPrunable
          && depth <= 2
-         && ((ssi->counterMoveHistory != nullptr) ? ssi->counterMoveHistory[pieceID][endSq] : 0) < 3 - 3 * depth * depth
-         && ((ssi->followupMoveHistory != nullptr) ? ssi->followupMoveHistory[pieceID][endSq] : 0) < 3 - 3 * depth * depth)
+         && ((ssi->counterMoveHistory != nullptr) ? historyLoad(ssi->counterMoveHistory[pieceID][endSq]) : 0) < 3 - 3 * depth * depth
+         && ((ssi->followupMoveHistory != nullptr) ? historyLoad(ssi->followupMoveHistory[pieceID][endSq]) : 0) < 3 - 3 * depth * depth)
             continue;
 
 
@@ -960,27 +1293,35 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
         if (!isPVNode && !isInCheck
          && bestScore > -MAX_PLY_MATE_SCORE
          && depth <= 5
-         && b.getSEEForMove(color, m) < -100*depth)
+         && !seeGreaterEqual(b, color, m, -100*depth, searchStats))
             continue;
 
 
-        // Copy the board and do the move
-        Board copy = b.staticCopy();
+        // Do the move, recording what is needed to take it back
+        UndoInfo undo;
         // If we are searching the hash move, we must use to a special
-        // move generator for extra verification.
+        // move generator for extra verification. Its child's hash entries are
+        // only fetched once the move is known to be valid here.
         if (m == hashed) {
-            if (!copy.doHashMove(m, color)) {
+            if (!b.doHashMove(m, color, undo)) {
                 hashed = NULL_MOVE;
                 moveSorter.hashed = NULL_MOVE;
-                moveSorter.generateMoves();
                 continue;
             }
-            moveSorter.generateMoves();
+            transpositionTable.prefetch(b.getZobristKey());
+            evalCache.prefetch(b.getZobristKey());
+        }
+        // All other moves from the move sorter are legal. Start fetching the
+        // child's hash entries so that the memory access overlaps with making
+        // the move.
+        else {
+            uint64_t childKey = b.getZobristKeyAfterMove(m, color);
+            transpositionTable.prefetch(childKey);
+            evalCache.prefetch(childKey);
+            b.doMove(m, color, undo);
         }
-        else if (!copy.doPseudoLegalMove(m, color))
-            continue;
         searchStats->nodes++;
-
+        bool givesCheck = b.isInCheck(color^1);
 
         int reduction = 0;
         // Late move reduction
@@ -989,7 +1330,7 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
         // fail-low.
         if (depth >= 3 && movesSearched > (isPVNode ? 4 : 2) + (unsigned int) isInCheck
          && !isCapture(m) && !isPromotion(m)
-         && !copy.isInCheck(color^1)) {
+         && !givesCheck) {
             // Increase reduction with higher depth and later moves
             // Idea for log-based formula from Stockfish
             reduction = (int) (0.5 + log(depth) * log(movesSearched) / 2.1);
@@ -1001,9 +1342,9 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
             if (isInCheck)
                 reduction--;
             // Reduce more for moves with poor history
-            int historyValue = searchParams->historyTable[color][pieceID][endSq]
-                + ((ssi->counterMoveHistory != nullptr) ? ssi->counterMoveHistory[pieceID][endSq] : 0)
-                + ((ssi->followupMoveHistory != nullptr) ? ssi->followupMoveHistory[pieceID][endSq] : 0);
+            int historyValue = historyLoad(searchParams->history->historyTable[color][pieceID][endSq])
+                + ((ssi->counterMoveHistory != nullptr) ? historyLoad(ssi->counterMoveHistory[pieceID][endSq]) : 0)
+                + ((ssi->followupMoveHistory != nullptr) ? historyLoad(ssi->followupMoveHistory[pieceID][endSq]) : 0);
             reduction -= historyValue / 512;
             // Reduce more for expected cut nodes
             if (isCutNode)
@@ -1016,88 +1357,115 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
             reduction = std::max(0, std::min(reduction, depth - 2));
         }
 
+        // Record two-fold stack since we may do a search for singular
+        // extensions. The undo record holds the key of this node.
+        threadMemoryArray[threadID]->twoFoldPositions.push(undo.zobristKey);
 
-        int extension = 0;
-        // Check extensions
-        if (reduction == 0
-         && copy.isInCheck(color^1)
-         && b.getSEEForMove(color, m) >= 0) {
-            extension++;
-        }
-
-        // Record two-fold stack since we may do a search for singular extensions
-        threadMemoryArray[threadID]->twoFoldPositions.push(b.getZobristKey());
-
-        // Singular extensions
-        // If the TT move appears to be much better than all others, extend the move
-        if (depth >= 7 && reduction == 0 && extension == 0
+        // The check and singular extensions look at this node's position, so
+        // the move is taken back while they are tested. This is only needed
+        // for unreduced checks and for the hash move at high depths.
+        bool tryCheckExtension = (reduction == 0 && givesCheck);
+        bool trySingularExtension = (depth >= 7 && reduction == 0
          && m == hashed
          && abs(hashScore) < NEAR_MATE_SCORE
          && (nodeType == CUT_NODE || nodeType == PV_NODE)
-         && hashDepth >= depth - 3) {
-            bool isSingular = true;
+         && hashDepth >= depth - 3);
 
-            // Do a reduced depth search with a lowered window for a fail low check
-            for (unsigned int i = 0; i < legalMoves.size(); i++) {
-                Move seMove = legalMoves.get(i);
-                Board seCopy = b.staticCopy();
-                // Search every move except the hash move
-                if (seMove == hashed)
-                    continue;
-                if (!seCopy.doPseudoLegalMove(seMove, color))
-                    continue;
-
-                (ssi+1)->counterMoveHistory = searchParams->counterMoveHistory
-                    [b.getPieceOnSquare(color, getStartSq(seMove))][getEndSq(seMove)];
-                (ssi+2)->followupMoveHistory = searchParams->followupMoveHistory
-                    [b.getPieceOnSquare(color, getStartSq(seMove))][getEndSq(seMove)];
-
-                // The window is lowered more for higher depths
-                int SEWindow = hashScore - 10 - depth;
-                // Do a reduced search for fail-low confirmation
-                int SEDepth = depth / 2 - 1;
+        int extension = 0;
+        if (tryCheckExtension || trySingularExtension) {
+            b.undoMove(m, color, undo);
 
-                score = -PVS(seCopy, SEDepth, -SEWindow - 1, -SEWindow, threadID, !isCutNode, ssi+1, &line);
+            // Check extensions
+            if (tryCheckExtension
+             && seeGreaterEqual(b, color, m, 0, searchStats)) {
+                extension++;
+            }
 
-                // If a move did not fail low, no singular extension
-                if (score > SEWindow) {
-                    isSingular = false;
-                    break;
+            // Singular extensions
+            // If the TT move appears to be much better than all others, extend the move
+            if (trySingularExtension && extension == 0) {
+                bool isSingular = true;
+                // The move sorter has only tried the hash move so far, so the
+                // other moves and the legality info are generated here
+                MoveList seMoves;
+                LegalityInfo seLegalityInfo = b.getLegalityInfo(color);
+                if (isInCheck)
+                    b.getPseudoLegalCheckEscapes(seMoves, color);
+                else
+                    b.getAllPseudoLegalMoves(seMoves, color);
+
+                // Do a reduced depth search with a lowered window for a fail low check
+                for (unsigned int i = 0; i < seMoves.size(); i++) {
+                    Move seMove = seMoves.get(i);
+                    // Search every move except the hash move
+                    if (seMove == hashed)
+                        continue;
+                    if (!b.isLegalMove(seMove, color, seLegalityInfo))
+                        continue;
+
+                    (ssi+1)->counterMoveHistory = searchParams->history->counterMoveHistory
+                        [b.getPieceOnSquare(color, getStartSq(seMove))][getEndSq(seMove)];
+                    (ssi+2)->followupMoveHistory = searchParams->history->followupMoveHistory
+                        [b.getPieceOnSquare(color, getStartSq(seMove))][getEndSq(seMove)];
+
+                    // The window is lowered more for higher depths
+                    int SEWindow = hashScore - 10 - depth;
+                    // Do a reduced search for fail-low confirmation
+                    int SEDepth = depth / 2 - 1;
+
+                    UndoInfo seUndo;
+                    b.doMove(seMove, color, seUndo);
+                    score = -PVS(b, SEDepth, -SEWindow - 1, -SEWindow, threadID, !isCutNode, ssi+1, &line);
+                    b.undoMove(seMove, color, seUndo);
+
+                    // If a move did not fail low, no singular extension
+                    if (score > SEWindow) {
+                        isSingular = false;
+                        break;
+                    }
                 }
+
+                // If all moves other than the hash move failed low, we extend for
+                // the singular move
+                if (isSingular)
+                    extension++;
             }
 
-            // If all moves other than the hash move failed low, we extend for
-            // the singular move
-            if (isSingular)
-                extension++;
+            b.doMove(m, color, undo);
         }
 
 
-        (ssi+1)->counterMoveHistory = searchParams->counterMoveHistory[pieceID][endSq];
-        (ssi+2)->followupMoveHistory = searchParams->followupMoveHistory[pieceID][endSq];
+        (ssi+1)->counterMoveHistory = searchParams->history->counterMoveHistory[pieceID][endSq];
+        (ssi+2)->followupMoveHistory = searchParams->history->followupMoveHistory[pieceID][endSq];
+
+        if (useABDADA)
+            startSearching(moveKey);
 
         // Null-window search, with re-search if applicable
         if (movesSearched != 0) {
-            score = -PVS(copy, depth-1-reduction+extension, -alpha-1, -alpha, threadID, true, ssi+1, &line);
+            score = -PVS(b, depth-1-reduction+extension, -alpha-1, -alpha, threadID, true, ssi+1, &line);
 
             // LMR re-search if the reduced search did not fail low
             if (reduction > 0 && score > alpha) {
-                score = -PVS(copy, depth-1+extension, -alpha-1, -alpha, threadID, !isCutNode, ssi+1, &line);
+                score = -PVS(b, depth-1+extension, -alpha-1, -alpha, threadID, !isCutNode, ssi+1, &line);
             }
 
             // Re-search for a scout window at PV nodes
             if (alpha < score && score < beta) {
-                score = -PVS(copy, depth-1+extension, -beta, -alpha, threadID, false, ssi+1, &line);
+                score = -PVS(b, depth-1+extension, -beta, -alpha, threadID, false, ssi+1, &line);
             }
         }
 
         // The first move is always searched at a normal depth
         else {
-            score = -PVS(copy, depth-1+extension, -beta, -alpha, threadID, (isPVNode ? false : !isCutNode), ssi+1, &line);
+            score = -PVS(b, depth-1+extension, -beta, -alpha, threadID, (isPVNode ? false : !isCutNode), ssi+1, &line);
         }
 
+        b.undoMove(m, color, undo);
         // Pop the position in case we return early from this search
         threadMemoryArray[threadID]->twoFoldPositions.pop();
+        if (useABDADA)
+            finishSearching(moveKey);
 
         // Stop condition to help break out as quickly as possible
         if (stopSignal.load(std::memory_order_relaxed))
@@ -1128,7 +1496,10 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
                         searchParams->killers[ssi->ply][0];
                     searchParams->killers[ssi->ply][0] = m;
                 }
-                moveSorter.updateHistories(m);
+                if (isDeferred)
+                    moveSorter.updateHistories(m, searchedQuiets);
+                else
+                    moveSorter.updateHistories(m);
             }
 
             changePV(m, pvLine, &line);
@@ -1142,10 +1513,13 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
             if (score > alpha) {
                 alpha = score;
                 toHash = m;
+                toHashDeferred = isDeferred;
                 changePV(m, pvLine, &line);
             }
         }
 
+        if (useABDADA && !isCapture(m))
+            searchedQuiets.add(m);
         movesSearched++;
     }
     // End main search loop
@@ -1169,8 +1543,12 @@ int PVS(Board &b, int depth, int alpha, int beta, int threadID, bool isCutNode,
         transpositionTable.add(b, hashData, depth, searchParams->rootMoveNumber);
 
         // Update histories for quiet moves
-        if (!isCapture(toHash))
-            moveSorter.updateHistories(toHash);
+        if (!isCapture(toHash)) {
+            if (toHashDeferred)
+                moveSorter.updateHistories(toHash, searchedQuiets);
+            else
+                moveSorter.updateHistories(toHash);
+        }
     }
 
     // Record all-nodes
@@ -1216,7 +1594,7 @@ int quiescence(Board &b, int plies, int alpha, int beta, int threadID) {
     if (b.isInsufficientMaterial())
         return 0;
     // Check for repetition draws while we are still considering checks
-    if (b.getFiftyMoveCounter() >= 2 && threadMemoryArray[threadID]->twoFoldPositions.find(b.getZobristKey()))
+    if (b.getFiftyMoveCounter() >= 2 && threadMemoryArray[threadID]->twoFoldPositions.find(b.getZobristKey(), b.getFiftyMoveCounter()))
         return 0;
 
     // Qsearch hash table probe
@@ -1250,15 +1628,25 @@ int quiescence(Board &b, int plies, int alpha, int beta, int threadID) {
     int standPat;
     // Probe the eval cache for a saved calculation
     searchStats->evalCacheProbes++;
-    int ehe = evalCache.get(b);
+    EvalHashProbe probe;
+    int ehe = evalCache.get(b, probe);
     if (ehe != 0) {
         searchStats->evalCacheHits++;
         standPat = ehe - EVAL_HASH_OFFSET;
     }
     else {
-        Eval e;
-        standPat = (color == WHITE) ? e.evaluate(b) : -e.evaluate(b);
-        evalCache.add(b, standPat);
+        if (probe == EVAL_HASH_COLLISION)
+            searchStats->evalCacheCollisions++;
+        else
+            searchStats->evalCacheMisses++;
+        // Lazy evaluation: the eval may return early with an estimate if the
+        // position is far outside the window
+        Eval e(&(threadMemoryArray[threadID]->pawnHash));
+        standPat = (color == WHITE) ? e.evaluate(b, alpha, beta) : -e.evaluate(b, -beta, -alpha);
+        searchStats->evalTiers[e.getEvalTier()]++;
+        // Only cache complete evaluations
+        if (e.getEvalTier() == EVAL_TIER_FULL)
+            evalCache.add(b, standPat);
     }
 
     // Use the TT score as a better "static" eval, if available.
@@ -1299,22 +1687,28 @@ int quiescence(Board &b, int plies, int alpha, int beta, int threadID) {
             continue;
         }
         // Futility pruning
-        if (standPat < alpha - 80 && b.getSEEForMove(color, m) <= 0) {
+        if (standPat < alpha - 80 && !seeGreaterEqual(b, color, m, 1, searchStats)) {
             bestScore = std::max(bestScore, standPat + 80);
             continue;
         }
         // Static exchange evaluation pruning
-        if (b.getExchangeScore(color, m) < 0 && b.getSEEForMove(color, m) < 0)
+        if (b.getExchangeScore(color, m) < 0 && !seeGreaterEqual(b, color, m, 0, searchStats))
             continue;
 
+        uint64_t childKey = b.getZobristKeyAfterMove(m, color);
+        transpositionTable.prefetch(childKey);
+        evalCache.prefetch(childKey);
 
-        Board copy = b.staticCopy();
-        if (!copy.doPseudoLegalMove(m, color))
+        UndoInfo undo;
+        if (!b.doPseudoLegalMove(m, color, undo)) {
+            b.undoMove(m, color, undo);
             continue;
+        }
 
         searchStats->nodes++;
         searchStats->qsNodes++;
-        score = -quiescence(copy, plies+1, -beta, -alpha, threadID);
+        score = -quiescence(b, plies+1, -beta, -alpha, threadID);
+        b.undoMove(m, color, undo);
 
         // Stop condition to help break out as quickly as possible
         if (stopSignal.load(std::memory_order_relaxed))
@@ -1349,16 +1743,19 @@ int quiescence(Board &b, int plies, int alpha, int beta, int threadID) {
         Move m = legalMoves.get(i);
 
         // Static exchange evaluation pruning
-        if (!isCapture(m) && b.getSEEForMove(color, m) < 0)
+        if (!isCapture(m) && !seeGreaterEqual(b, color, m, 0, searchStats))
             continue;
 
-        Board copy = b.staticCopy();
-        if (!copy.doPseudoLegalMove(m, color))
+        UndoInfo undo;
+        if (!b.doPseudoLegalMove(m, color, undo)) {
+            b.undoMove(m, color, undo);
             continue;
+        }
 
         searchStats->nodes++;
         searchStats->qsNodes++;
-        score = -quiescence(copy, plies+1, -beta, -alpha, threadID);
+        score = -quiescence(b, plies+1, -beta, -alpha, threadID);
+        b.undoMove(m, color, undo);
 
         if (score >= beta) {
             searchStats->qsFailHighs++;
@@ -1398,20 +1795,24 @@ int quiescence(Board &b, int plies, int alpha, int beta, int threadID) {
                     continue;
                 }
                 // Static exchange evaluation pruning
-                if (b.getSEEForMove(color, m) < 0)
+                if (!seeGreaterEqual(b, color, m, 0, searchStats))
                     continue;
 
-                Board copy = b.staticCopy();
-                if (!copy.doPseudoLegalMove(m, color))
+                uint64_t key = b.getZobristKey();
+                UndoInfo undo;
+                if (!b.doPseudoLegalMove(m, color, undo)) {
+                    b.undoMove(m, color, undo);
                     continue;
+                }
 
                 searchStats->nodes++;
                 searchStats->qsNodes++;
-                threadMemoryArray[threadID]->twoFoldPositions.push(b.getZobristKey());
+                threadMemoryArray[threadID]->twoFoldPositions.push(key);
 
-                int score = -checkQuiescence(copy, plies+1, -beta, -alpha, threadID);
+                int score = -checkQuiescence(b, plies+1, -beta, -alpha, threadID);
 
                 threadMemoryArray[threadID]->twoFoldPositions.pop();
+                b.undoMove(m, color, undo);
 
                 if (score >= beta) {
                     searchStats->qsFailHighs++;
@@ -1447,7 +1848,7 @@ int quiescence(Board &b, int plies, int alpha, int beta, int threadID) {
  * not just captures, necessitating this function.
  */
 int checkQuiescence(Board &b, int plies, int alpha, int beta, int threadID) {
-    if (b.getFiftyMoveCounter() >= 2 && threadMemoryArray[threadID]->twoFoldPositions.find(b.getZobristKey()))
+    if (b.getFiftyMoveCounter() >= 2 && threadMemoryArray[threadID]->twoFoldPositions.find(b.getZobristKey(), b.getFiftyMoveCounter()))
         return 0;
 
     SearchParameters *searchParams = &(threadMemoryArray[threadID]->searchParams);
@@ -1462,20 +1863,24 @@ int checkQuiescence(Board &b, int plies, int alpha, int beta, int threadID) {
     for (unsigned int i = 0; i < legalMoves.size(); i++) {
         Move m = legalMoves.get(i);
 
-        if (bestScore > -INFTY && b.getSEEForMove(color, m) < 0)
+        if (bestScore > -INFTY && !seeGreaterEqual(b, color, m, 0, searchStats))
             continue;
 
-        Board copy = b.staticCopy();
-        if (!copy.doPseudoLegalMove(m, color))
+        uint64_t key = b.getZobristKey();
+        UndoInfo undo;
+        if (!b.doPseudoLegalMove(m, color, undo)) {
+            b.undoMove(m, color, undo);
             continue;
+        }
 
         searchStats->nodes++;
         searchStats->qsNodes++;
-        threadMemoryArray[threadID]->twoFoldPositions.push(b.getZobristKey());
+        threadMemoryArray[threadID]->twoFoldPositions.push(key);
 
-        score = -quiescence(copy, plies+1, -beta, -alpha, threadID);
+        score = -quiescence(b, plies+1, -beta, -alpha, threadID);
 
         threadMemoryArray[threadID]->twoFoldPositions.pop();
+        b.undoMove(m, color, undo);
 
         if (score >= beta) {
             searchStats->qsFailHighs++;
@@ -1529,6 +1934,17 @@ int adjustHashScore(int score, int plies) {
     return score;
 }
 
+// Tests whether the SEE of a move is at least the threshold, recording how
+// often the test finishes early
+bool seeGreaterEqual(Board &b, int color, Move m, int threshold, SearchStatistics *searchStats) {
+    bool earlyExit;
+    bool result = b.getSEEGreaterEqual(color, m, threshold, &earlyExit);
+    searchStats->seeTests++;
+    if (earlyExit)
+        searchStats->seeEarlyExits++;
+    return result;
+}
+
 
 // Pondering
 void startPonder() {
@@ -1546,18 +1962,215 @@ void stopPonder() {
 
 // These functions help to communicate with uci.cpp
 void clearTables() {
-    transpositionTable.clear();
-    evalCache.clear();
-    for (int i = 0; i < numThreads; i++)
+    lastSearch.valid = false;
+    tablesInUse = false;
+    transpositionTable.clear(numThreads);
+    evalCache.clear(numThreads);
+    sharedHistory.clear();
+    for (int i = 0; i < numThreads; i++) {
         threadMemoryArray[i]->searchParams.resetHistoryTable();
+        threadMemoryArray[i]->pawnHash.clear();
+    }
 }
 
+// The tables are allocated and cleared by as many threads as the search uses.
+// Pending output is written first, since the output thread reads the table.
 void setHashSize(uint64_t MB) {
-    transpositionTable.setSize(MB);
+    hashSizeMB = MB;
+    lastSearch.valid = false;
+    waitForOutput();
+    transpositionTable.setSize(MB, numThreads);
 }
 
 void setEvalCacheSize(uint64_t MB) {
-    evalCache.setSize(MB);
+    evalCacheSizeMB = MB;
+    evalCache.setSize(MB, numThreads);
+}
+
+uint64_t getHashSize() {
+    return hashSizeMB;
+}
+
+// Saves the transposition table to a file, or loads it from one
+bool saveHashTable(const std::string &path) {
+    return transpositionTable.save(path);
+}
+
+// The table takes the size saved in the file, so the hash size is updated to
+// match it
+bool loadHashTable(const std::string &path) {
+    lastSearch.valid = false;
+    waitForOutput();
+    if (!transpositionTable.load(path))
+        return false;
+    uint64_t bytes = transpositionTable.getSize() / NUM_HASH_SLOTS * sizeof(HashNode);
+    hashSizeMB = std::max(bytes >> 20, (uint64_t) MIN_HASH_SIZE);
+    tablesInUse = true;
+    return true;
+}
+
+// Reallocates the hash tables, interleaved across NUMA nodes if requested
+void setNumaInterleave(bool interleave) {
+    setTableInterleave(interleave);
+    setHashSize(hashSizeMB);
+    setEvalCacheSize(evalCacheSizeMB);
+}
+
+// Sets up the root moves to continue the last search if it can be reused,
+// returning the depth to resume at or 0 if it cannot be reused
+int getReuseDepth(Board *b, MoveList &legalMoves, int &score, Move &ponder) {
+    if (!lastSearch.valid)
+        return 0;
+
+    uint64_t rootKey = b->getZobristKey();
+    int depth;
+    int pvStart;
+    // Searching the same position again: keep the whole root move ordering
+    if (rootKey == lastSearch.rootKey) {
+        MoveList ordered;
+        for (unsigned int i = 0; i < lastSearch.rootMoves.size(); i++) {
+            for (unsigned int j = 0; j < legalMoves.size(); j++) {
+                if (legalMoves.get(j) == lastSearch.rootMoves.get(i)) {
+                    ordered.add(legalMoves.get(j));
+                    legalMoves.remove(j);
+                    break;
+                }
+            }
+        }
+        for (unsigned int j = 0; j < legalMoves.size(); j++)
+            ordered.add(legalMoves.get(j));
+        legalMoves = ordered;
+        depth = lastSearch.depth;
+        pvStart = 0;
+    }
+    // The expected reply was played: the rest of the PV is two plies shorter
+    else if (rootKey == lastSearch.predictedKey) {
+        unsigned int index = 0;
+        while (index < legalMoves.size() && legalMoves.get(index) != lastSearch.pvLine.pv[2])
+            index++;
+        if (index == legalMoves.size())
+            return 0;
+        legalMoves.swap(0, index);
+        depth = lastSearch.depth - 2;
+        pvStart = 2;
+    }
+    else
+        return 0;
+
+    score = lastSearch.score;
+    if (lastSearch.pvLine.pvLength > pvStart + 1)
+        ponder = lastSearch.pvLine.pv[pvStart+1];
+    return depth - reuseDepthOffset;
+}
+
+// Keeps the results of a finished search for the next one to resume from
+void saveSearch(Board *b, MoveList &legalMoves, SearchPV &pvLine, int depth, int score) {
+    lastSearch.valid = true;
+    lastSearch.rootKey = b->getZobristKey();
+    lastSearch.predictedKey = 0;
+    if (pvLine.pvLength >= 3) {
+        int color = b->getPlayerToMove();
+        Board copy = b->staticCopy();
+        copy.doMove(pvLine.pv[0], color);
+        copy.doMove(pvLine.pv[1], color^1);
+        lastSearch.predictedKey = copy.getZobristKey();
+    }
+    lastSearch.depth = depth;
+    lastSearch.score = score;
+    lastSearch.rootMoves = legalMoves;
+    lastSearch.pvLine = pvLine;
+}
+
+// ABDADA: the entry in the searching table for move m from position b
+uint64_t getSearchingKey(Board &b, Move m) {
+    return b.getZobristKey() ^ ((uint64_t) m * 0x9E3779B97F4A7C15ULL);
+}
+
+static uint32_t getSearchingTag(uint64_t moveKey) {
+    return (uint32_t) (moveKey >> 32) & ~SEARCHING_COUNT_MASK;
+}
+
+// Whether some thread is currently searching the move
+bool isSearchedElsewhere(uint64_t moveKey) {
+    uint32_t entry = searchingMoves[moveKey & ((1 << SEARCHING_TABLE_BITS) - 1)]
+        .load(std::memory_order_relaxed);
+    return (entry & ~SEARCHING_COUNT_MASK) == getSearchingTag(moveKey)
+        && (entry & SEARCHING_COUNT_MASK) != 0;
+}
+
+// Adds a searcher to the move's entry, taking the entry over if it belongs to
+// another move
+void startSearching(uint64_t moveKey) {
+    std::atomic<uint32_t> &slot = searchingMoves[moveKey & ((1 << SEARCHING_TABLE_BITS) - 1)];
+    uint32_t tag = getSearchingTag(moveKey);
+    uint32_t entry = slot.load(std::memory_order_relaxed);
+    uint32_t updated;
+    do {
+        if ((entry & ~SEARCHING_COUNT_MASK) != tag || (entry & SEARCHING_COUNT_MASK) == 0)
+            updated = tag | 1;
+        else if ((entry & SEARCHING_COUNT_MASK) == SEARCHING_COUNT_MASK)
+            return;
+        else
+            updated = entry + 1;
+    } while (!slot.compare_exchange_weak(entry, updated, std::memory_order_relaxed));
+}
+
+// Removes a searcher from the move's entry, so that the entry is only cleared
+// by the last thread searching the move. Entries taken over by another move
+// are left alone.
+void finishSearching(uint64_t moveKey) {
+    std::atomic<uint32_t> &slot = searchingMoves[moveKey & ((1 << SEARCHING_TABLE_BITS) - 1)];
+    uint32_t tag = getSearchingTag(moveKey);
+    uint32_t entry = slot.load(std::memory_order_relaxed);
+    uint32_t updated;
+    do {
+        if ((entry & ~SEARCHING_COUNT_MASK) != tag || (entry & SEARCHING_COUNT_MASK) == 0)
+            return;
+        updated = ((entry & SEARCHING_COUNT_MASK) == 1) ? 0 : entry - 1;
+    } while (!slot.compare_exchange_weak(entry, updated, std::memory_order_relaxed));
+}
+
+// Formats a score for UCI output, in mate or centipawns
+std::string scoreToString(int score, bool tbProbeSuccess, int tbScore) {
+    std::ostringstream str;
+    if (score >= MAX_PLY_MATE_SCORE)
+        // If it is our mate, it takes plies / 2 + 1 moves to mate since
+        // our move ends the game
+        str << "mate " << (MATE_SCORE - score) / 2 + 1;
+    else if (score <= -MAX_PLY_MATE_SCORE)
+        // If we are being mated, it takes plies / 2 moves since our
+        // opponent's move ends the game
+        str << "mate " << (-MATE_SCORE - score) / 2;
+    else
+        // Scale score into centipawns using our internal pawn value
+        str << "cp " << (tbProbeSuccess ? (tbScore == 0 ? 0 : (score/10 + tbScore)) : score) * 100 / PIECE_VALUES[EG][PAWNS];
+    return str.str();
+}
+
+// Returns whether enough time has passed since the last info line to send a
+// throttled one, and if so counts it as sent
+bool isInfoDue(uint64_t timeSoFar) {
+    if (lastInfoTime != 0 && timeSoFar < lastInfoTime + minInfoInterval)
+        return false;
+    lastInfoTime = timeSoFar;
+    return true;
+}
+
+void setInfoInterval(int ms) {
+    minInfoInterval = (uint64_t) ms;
+}
+
+void setSearchReuse(bool enabled) {
+    searchReuse = enabled;
+}
+
+void setReuseDepthOffset(int plies) {
+    reuseDepthOffset = plies;
+}
+
+// Estimates how full the transposition table is, in permill
+int getHashfull(uint8_t age) {
+    return transpositionTable.estimateHashfull(age);
 }
 
 uint64_t getNodes() {
@@ -1581,14 +2194,102 @@ void setMultiPV(unsigned int n) {
 }
 
 void setNumThreads(int n) {
+    stopHelperThreads();
+    int oldThreads = numThreads;
     numThreads = n;
 
-    while ((int) threadMemoryArray.size() < n)
-        threadMemoryArray.push_back(new ThreadMemory());
-    while ((int) threadMemoryArray.size() > n) {
-        delete threadMemoryArray.back();
-        threadMemoryArray.pop_back();
+    if (threadBinding == BIND_NONE) {
+        while ((int) threadMemoryArray.size() < n)
+            threadMemoryArray.push_back(new ThreadMemory());
+        while ((int) threadMemoryArray.size() > n) {
+            delete threadMemoryArray.back();
+            threadMemoryArray.pop_back();
+        }
+    }
+    else {
+        // All thread memory is reallocated on the node of its thread, the
+        // helpers doing so themselves. The main search thread is started anew
+        // for each search, so its memory is allocated by a temporary thread
+        // pinned the same way.
+        ThreadMemory *mainMemory = nullptr;
+        std::thread([&mainMemory] {
+            bindThisThread(0, threadBinding);
+            mainMemory = new ThreadMemory();
+        }).join();
+        // Keep the game history for repetition detection
+        mainMemory->twoFoldPositions = threadMemoryArray[0]->twoFoldPositions;
+
+        for (unsigned int i = 0; i < threadMemoryArray.size(); i++)
+            delete threadMemoryArray[i];
+        threadMemoryArray.assign(n, nullptr);
+        threadMemoryArray[0] = mainMemory;
+    }
+
+    // The hash tables are first touched by as many threads as search, so on
+    // NUMA machines they are reallocated to spread them over the nodes the new
+    // threads run on. Tables holding entries are kept as they are.
+    if (oldThreads != 0 && n != oldThreads && !tablesInUse && getNumaNodeCount() > 1) {
+        setHashSize(hashSizeMB);
+        setEvalCacheSize(evalCacheSizeMB);
+    }
+
+    helpersStarted = 0;
+    for (int i = 1; i < n; i++)
+        helperThreads.push_back(std::thread(helperThreadLoop, i));
+    {
+        std::unique_lock<std::mutex> lock(helperMutex);
+        helperDoneCV.wait(lock, [n] { return helpersStarted == n - 1; });
+    }
+
+    // Point any new threads at the shared history tables if necessary
+    setSharedHistory(useSharedHistory);
+}
+
+// Sets how search threads are pinned to CPUs, and moves the memory of each
+// thread to its new node. Must not be called during a search.
+void setThreadBinding(ThreadBinding binding) {
+    threadBinding = binding;
+    setNumThreads(numThreads);
+}
+
+void setSMPMode(SMPMode mode) {
+    smpMode = mode;
+}
+
+ThreadBinding getThreadBinding() {
+    return threadBinding;
+}
+
+// Switches all threads between their own history tables and one set of
+// history tables shared between all threads. Must not be called during a search.
+void setSharedHistory(bool shared) {
+    useSharedHistory = shared;
+    for (int i = 0; i < numThreads; i++) {
+        SearchParameters &sp = threadMemoryArray[i]->searchParams;
+        sp.history = shared ? &sharedHistory : &sp.ownHistory;
+    }
+}
+
+bool getSharedHistory() {
+    return useSharedHistory;
+}
+
+int getNumThreads() {
+    return numThreads;
+}
+
+// Wakes up and joins all helper threads. Must not be called during a search.
+void stopHelperThreads() {
+    {
+        std::lock_guard<std::mutex> lock(helperMutex);
+        helpersExit = true;
     }
+    helperStartCV.notify_all();
+
+    for (unsigned int i = 0; i < helperThreads.size(); i++)
+        helperThreads[i].join();
+    helperThreads.clear();
+    helpersExit = false;
 }
 
 void initPerThreadMemory() {
@@ -1659,9 +2360,8 @@ double getPercentage(uint64_t numerator, uint64_t denominator) {
     return percent;
 }
 
-// Prints the statistics gathered during search
-void printStatistics() {
-    // Aggregate statistics over all threads
+// Sums the statistics gathered by each thread
+SearchStatistics aggregateStatistics() {
     SearchStatistics searchStats;
     for (int i = 0; i < numThreads; i++) {
         searchStats.nodes +=            threadMemoryArray[i]->searchStats.nodes;
@@ -1677,7 +2377,36 @@ void printStatistics() {
         searchStats.qsFirstFailHighs += threadMemoryArray[i]->searchStats.qsFirstFailHighs;
         searchStats.evalCacheProbes +=  threadMemoryArray[i]->searchStats.evalCacheProbes;
         searchStats.evalCacheHits +=    threadMemoryArray[i]->searchStats.evalCacheHits;
+        searchStats.evalCacheMisses +=  threadMemoryArray[i]->searchStats.evalCacheMisses;
+        searchStats.evalCacheCollisions += threadMemoryArray[i]->searchStats.evalCacheCollisions;
+        searchStats.seeTests +=         threadMemoryArray[i]->searchStats.seeTests;
+        searchStats.seeEarlyExits +=    threadMemoryArray[i]->searchStats.seeEarlyExits;
+        for (int j = 0; j <= EVAL_TIER_FULL; j++)
+            searchStats.evalTiers[j] += threadMemoryArray[i]->searchStats.evalTiers[j];
     }
+    return searchStats;
+}
+
+// Summarizes the last search for bench
+SearchSummary getSearchSummary() {
+    SearchStatistics searchStats = aggregateStatistics();
+    SearchSummary summary;
+    summary.nodes = searchStats.nodes;
+    summary.depth = completedDepth;
+    summary.selectiveDepth = getSelectiveDepth();
+    summary.hashProbes = searchStats.hashProbes;
+    summary.hashHits = searchStats.hashHits;
+    summary.evalCacheProbes = searchStats.evalCacheProbes;
+    summary.evalCacheHits = searchStats.evalCacheHits;
+    return summary;
+}
+
+// Prints the statistics gathered during search
+void printStatistics() {
+    SearchStatistics searchStats = aggregateStatistics();
+    uint64_t qsEvals = searchStats.evalTiers[EVAL_TIER_MATERIAL]
+                     + searchStats.evalTiers[EVAL_TIER_KING_SAFETY]
+                     + searchStats.evalTiers[EVAL_TIER_FULL];
 
     cerr << std::setw(22) << "Hash hit rate: " << getPercentage(searchStats.hashHits, searchStats.hashProbes)
          << '%' << " of " << searchStats.hashProbes << " probes" << endl;
@@ -1693,4 +2422,62 @@ void printStatistics() {
          << '%' << " of " << searchStats.qsFailHighs << " qs fail highs" << endl;
     cerr << std::setw(22) << "Eval cache hit rate: " << getPercentage(searchStats.evalCacheHits, searchStats.evalCacheProbes)
          << '%' << " of " << searchStats.evalCacheProbes << " probes" << endl;
-}
\ No newline at end of file
+    cerr << std::setw(22) << "Eval cache misses: " << searchStats.evalCacheMisses << ", "
+         << searchStats.evalCacheCollisions << " collisions (full buckets)" << endl;
+    cerr << std::setw(22) << "SEE early exits: " << getPercentage(searchStats.seeEarlyExits, searchStats.seeTests)
+         << '%' << " of " << searchStats.seeTests << " threshold tests" << endl;
+    cerr << std::setw(22) << "QS lazy eval exits: "
+         << getPercentage(searchStats.evalTiers[EVAL_TIER_MATERIAL], qsEvals) << "% material, "
+         << getPercentage(searchStats.evalTiers[EVAL_TIER_KING_SAFETY], qsEvals) << "% king safety, of "
+         << qsEvals << " evals" << endl;
+}
+
+// Prints the time spent in each instrumented subsystem since the profile was
+// last cleared, summed over all threads. Only available in "make profile"
+// builds.
+void printProfile() {
+#ifdef LASER_PROFILE
+    ProfileData total;
+    for (int i = 0; i < numThreads; i++) {
+        for (int j = 0; j < NUM_PROFILE_COUNTERS; j++) {
+            total.cycles[j] += threadMemoryArray[i]->profile.cycles[j];
+            total.calls[j] += threadMemoryArray[i]->profile.calls[j];
+        }
+    }
+
+    cerr << std::setw(18) << "Subsystem" << std::setw(16) << "Calls"
+         << std::setw(16) << "Mcycles" << std::setw(12) << "Cycles/call"
+         << std::setw(10) << "Search %" << endl;
+    for (int j = 0; j < NUM_PROFILE_COUNTERS; j++) {
+        cerr << std::setw(18) << PROFILE_COUNTER_NAMES[j]
+             << std::setw(16) << total.calls[j]
+             << std::setw(16) << total.cycles[j] / 1000000
+             << std::setw(12) << ((total.calls[j] == 0) ? 0 : total.cycles[j] / total.calls[j])
+             << std::setw(9) << getPercentage(total.cycles[j], total.cycles[PROFILE_SEARCH])
+             << '%' << endl;
+    }
+
+    if (numThreads > 1) {
+        for (int i = 0; i < numThreads; i++) {
+            ProfileData &profile = threadMemoryArray[i]->profile;
+            cerr << "Thread " << i << ": " << profile.cycles[PROFILE_SEARCH] / 1000000
+                 << " Mcycles searching";
+            for (int j = PROFILE_EVAL; j < NUM_PROFILE_COUNTERS; j++) {
+                cerr << ", " << PROFILE_COUNTER_NAMES[j] << " "
+                     << getPercentage(profile.cycles[j], profile.cycles[PROFILE_SEARCH]) << '%';
+            }
+            cerr << endl;
+        }
+    }
+#else
+    cerr << "Profiling is not enabled in this build, use make profile" << endl;
+#endif
+}
+
+// Resets the profile of every thread. Must not be called during a search.
+void clearProfile() {
+#ifdef LASER_PROFILE
+    for (int i = 0; i < numThreads; i++)
+        threadMemoryArray[i]->profile.clear();
+#endif
+}
@@ -19,10 +19,18 @@
 #ifndef __SEARCH_H__
 #define __SEARCH_H__
 
+#include <algorithm>
+#include <cstring>
 #include "board.h"
 #include "common.h"
+#include "searchparams.h"
 #include "timeman.h"
 
+// Size of the repetition filter, must be a power of two
+const unsigned int TWOFOLD_FILTER_SIZE = 512;
+// Placeholder pushed onto the two fold stack for a null move
+const uint64_t NULL_MOVE_KEY = 0;
+
 /*
  * This struct is a simple stack implementation that stores Zobrist keys to
  * check for two-fold repetition.
@@ -33,34 +41,64 @@
  * only find the first repeat from the top of the stack since we have the
  * condition that the branch terminates immediately returning 0 if two-fold
  * repetition occurs in that branch.
+ * Only positions with the same side to move since the last irreversible move
+ * and the last null move can repeat, so find() steps back two plies at a time
+ * and stops at whichever comes first. A count of the keys on the stack by their
+ * low bits lets most lookups return without scanning at all.
  */
 struct TwoFoldStack {
 public:
     uint64_t keys[256];
     unsigned int length;
+    uint8_t filter[TWOFOLD_FILTER_SIZE];
 
     TwoFoldStack() {
-        length = 0;
+        clear();
     }
     ~TwoFoldStack() {}
 
+    // Only the used part of the stack is copied
+    TwoFoldStack &operator=(const TwoFoldStack &other) {
+        length = other.length;
+        std::memcpy(keys, other.keys, length * sizeof(uint64_t));
+        std::memcpy(filter, other.filter, sizeof(filter));
+        return *this;
+    }
+
     unsigned int size() { return length; }
 
     void push(uint64_t pos) {
         keys[length] = pos;
         length++;
+        filter[pos & (TWOFOLD_FILTER_SIZE-1)]++;
     }
 
-    void pop() { length--; }
+    // Marks a null move, which no repetition can be found across
+    void pushNullMove() { push(NULL_MOVE_KEY); }
+
+    void pop() {
+        length--;
+        filter[keys[length] & (TWOFOLD_FILTER_SIZE-1)]--;
+    }
 
     void clear() {
         length = 0;
+        std::memset(filter, 0, sizeof(filter));
     }
 
-    bool find(uint64_t pos) {
-        for (unsigned int i = length; i > 0; i--) {
-            if (keys[i-1] == pos)
+    bool find(uint64_t pos, int fiftyMoveCounter) {
+        if (filter[pos & (TWOFOLD_FILTER_SIZE-1)] == 0)
+            return false;
+        int end = std::max((int) length - fiftyMoveCounter, 0);
+        // Only every other key can repeat the position, but a null move
+        // marker at either ply ends the scan
+        for (int i = (int) length - 2; i >= end; i -= 2) {
+            if (keys[i+1] == NULL_MOVE_KEY)
+                break;
+            if (keys[i] == pos)
                 return true;
+            if (keys[i] == NULL_MOVE_KEY)
+                break;
         }
         return false;
     }
@@ -72,17 +110,54 @@ public:
 struct SearchStackInfo {
     int ply;
     int staticEval;
-    int **counterMoveHistory;
-    int **followupMoveHistory;
+    // [piece][to square] tables of the continuation histories for this ply
+    HistoryScore (*counterMoveHistory)[64];
+    HistoryScore (*followupMoveHistory)[64];
+};
+
+// A summary of the statistics of the last search, reported by bench
+struct SearchSummary {
+    uint64_t nodes;
+    int depth;
+    int selectiveDepth;
+    uint64_t hashProbes, hashHits;
+    uint64_t evalCacheProbes, evalCacheHits;
+};
+
+// How the threads share the work of a search
+enum SMPMode {
+    // Helpers search the whole tree independently, some at greater depths
+    SMP_LAZY,
+    // All threads search the same depth, deferring moves that another thread
+    // is already searching
+    SMP_ABDADA
 };
 
 void getBestMove(Board *b, TimeManagement *timeParams, MoveList *movesToSearch);
 void clearTables();
 void setHashSize(uint64_t MB);
 void setEvalCacheSize(uint64_t MB);
+uint64_t getHashSize();
+void setNumaInterleave(bool interleave);
+bool saveHashTable(const std::string &path);
+bool loadHashTable(const std::string &path);
 uint64_t getNodes();
+void setInfoInterval(int ms);
+void setSearchReuse(bool enabled);
+void setReuseDepthOffset(int plies);
+int getHashfull(uint8_t age);
+SearchSummary getSearchSummary();
+void printProfile();
+void clearProfile();
 void setMultiPV(unsigned int n);
 void setNumThreads(int n);
+int getNumThreads();
+void setThreadBinding(ThreadBinding binding);
+void setSMPMode(SMPMode mode);
+ThreadBinding getThreadBinding();
+void setSharedHistory(bool shared);
+bool getSharedHistory();
+void stopHelperThreads();
 void initPerThreadMemory();
 TwoFoldStack *getTwoFoldStackPointer();
 
@@ -19,56 +19,74 @@
 #ifndef __SEARCHPARAMS_H__
 #define __SEARCHPARAMS_H__
 
+#include <atomic>
+#include <cstring>
 #include "common.h"
 
+/*
+ * History scores may be shared between search threads (the SharedHistory
+ * option), so they are stored as atomics and accessed with relaxed loads and
+ * stores. Updates are a separate load and store rather than a locked
+ * read-modify-write: an occasional lost update is harmless for move ordering.
+ * On x86 these compile to plain moves, so private tables pay nothing for it.
+ * The update rule in MoveOrder keeps scores within about +-800, so 16 bits
+ * are enough.
+ */
+typedef std::atomic<int16_t> HistoryScore;
+
+inline int historyLoad(const HistoryScore &h) {
+    return h.load(std::memory_order_relaxed);
+}
+
+inline void historyStore(HistoryScore &h, int value) {
+    h.store((int16_t) value, std::memory_order_relaxed);
+}
+
+// Continuation histories, indexed by the [piece][to square] of the previous
+// move and then the [piece][to square] of the current move
+typedef HistoryScore ContinuationHistory[6][64][6][64];
+
+// The move ordering history tables, owned by a thread or shared by all threads
+struct HistoryTables {
+    HistoryScore historyTable[2][6][64];
+    // Both continuation histories live in one aligned allocation
+    HistoryScore (*counterMoveHistory)[64][6][64];
+    HistoryScore (*followupMoveHistory)[64][6][64];
+
+    HistoryTables() {
+        counterMoveHistory = (HistoryScore (*)[64][6][64])
+            allocateTable(2 * sizeof(ContinuationHistory));
+        followupMoveHistory = counterMoveHistory + 6;
+        clear();
+    }
+
+    HistoryTables(const HistoryTables &other) = delete;
+    HistoryTables& operator=(const HistoryTables &other) = delete;
+
+    ~HistoryTables() {
+        freeTable(counterMoveHistory);
+    }
+
+    void clear() {
+        std::memset((void *) historyTable, 0, sizeof(historyTable));
+        std::memset((void *) counterMoveHistory, 0, 2 * sizeof(ContinuationHistory));
+    }
+};
+
 struct SearchParameters {
     int ply;
     int nullMoveCount;
     int selectiveDepth;
     uint8_t rootMoveNumber;
     Move killers[MAX_DEPTH][2];
-    int historyTable[2][6][64];
-    int **counterMoveHistory[6][64];
-    int **followupMoveHistory[6][64];
+    // The history tables used by this thread: either ownHistory, or the
+    // shared tables if SharedHistory is on
+    HistoryTables *history;
+    HistoryTables ownHistory;
 
     SearchParameters() {
-        for (int i = 0; i < 6; i++) {
-            for (int j = 0; j < 64; j++) {
-                counterMoveHistory[i][j] = new int *[6];
-                for (int k = 0; k < 6; k++) {
-                    counterMoveHistory[i][j][k] = new int[64];
-                }
-            }
-        }
-        for (int i = 0; i < 6; i++) {
-            for (int j = 0; j < 64; j++) {
-                followupMoveHistory[i][j] = new int *[6];
-                for (int k = 0; k < 6; k++) {
-                    followupMoveHistory[i][j][k] = new int[64];
-                }
-            }
-        }
+        history = &ownHistory;
         reset();
-        resetHistoryTable();
-    }
-
-    ~SearchParameters() {
-        for (int i = 0; i < 6; i++) {
-            for (int j = 0; j < 64; j++) {
-                for (int k = 0; k < 6; k++) {
-                    delete[] counterMoveHistory[i][j][k];
-                }
-                delete[] counterMoveHistory[i][j];
-            }
-        }
-        for (int i = 0; i < 6; i++) {
-            for (int j = 0; j < 64; j++) {
-                for (int k = 0; k < 6; k++) {
-                    delete[] followupMoveHistory[i][j][k];
-                }
-                delete[] followupMoveHistory[i][j];
-            }
-        }
     }
 
     void reset() {
@@ -82,30 +100,7 @@ struct SearchParameters {
     }
 
     void resetHistoryTable() {
-        for (int i = 0; i < 2; i++) {
-            for (int j = 0; j < 6; j++) {
-                for (int k = 0; k < 64; k++)
-                    historyTable[i][j][k] = 0;
-            }
-        }
-
-        for (int i = 0; i < 6; i++) {
-            for (int j = 0; j < 64; j++) {
-                for (int k = 0; k < 6; k++) {
-                    for (int l = 0; l < 64; l++)
-                        counterMoveHistory[i][j][k][l] = 0;
-                }
-            }
-        }
-
-        for (int i = 0; i < 6; i++) {
-            for (int j = 0; j < 64; j++) {
-                for (int k = 0; k < 6; k++) {
-                    for (int l = 0; l < 64; l++)
-                        followupMoveHistory[i][j][k][l] = 0;
-                }
-            }
-        }
+        ownHistory.clear();
     }
 };
 
@@ -26,10 +26,15 @@
 #define DECOMP64
 // #endif
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include "../bbinit.h"
 #include "../board.h"
 #include "../common.h"
 #include "../eval.h"
+#include "../profile.h"
 #include "../search.h"
 #include "../uci.h"
 
@@ -42,6 +47,18 @@ extern uint64_t zobristTable[794];
 
 #include "tbcore.c"
 
+// Lock-free cache of WDL probe results shared by all search threads, so that
+// repeated probes of a position skip capture resolution and decompression.
+// Each entry packs the upper Zobrist key bits with the success code in bits
+// 4-7 and the WDL value + 2 in bits 0-3.
+#define WDL_CACHE_BITS 16
+static std::atomic<uint64> WDL_cache[1 << WDL_CACHE_BITS];
+
+// Background thread mapping the tables reachable from the root
+static std::thread warmupThread;
+static std::atomic<bool> warmupStop(false);
+static uint64 warmupKey = 0;
+
 // Given a position with 6 or fewer pieces, produce a text string
 // of the form KQPvKRP, where "KQP" represents the white pieces if
 // mirror == 0 and the black pieces if mirror == 1.
@@ -59,6 +76,20 @@ static void prt_str(Board &b, char *str, int mirror) {
     *str++ = 0;
 }
 
+// Same as prt_str, but for the material combination defined by pcs[16].
+static void prt_str_from_pcs(int *pcs, char *str, int mirror) {
+    int color = (mirror == 0) ? 0 : 8;
+    for (int pt = KINGS; pt >= PAWNS; pt--)
+        for (int i = pcs[color + pt + 1]; i > 0; i--)
+            *str++ = pchr[5 - pt];
+    *str++ = 'v';
+    color ^= 8;
+    for (int pt = KINGS; pt >= PAWNS; pt--)
+        for (int i = pcs[color + pt + 1]; i > 0; i--)
+            *str++ = pchr[5 - pt];
+    *str++ = 0;
+}
+
 // Given a position, produce a 64-bit material signature key.
 // Again no need to make this very efficient.
 static uint64 calc_key(Board &b, int mirror) {
@@ -362,7 +393,7 @@ static int probe_ab(Board &b, int alpha, int beta, int *success) {
 //  0 : draw
 //  1 : win, but draw under 50-move rule
 //  2 : win
-int probe_wdl(Board &b, int *success) {
+static int probe_wdl_uncached(Board &b, int *success) {
     *success = 1;
     int color = b.getPlayerToMove();
 
@@ -455,6 +486,142 @@ int probe_wdl(Board &b, int *success) {
     return v;
 }
 
+// Probes the WDL tables through the shared result cache. Failed probes are
+// not cached so that a later probe can retry once the table is available.
+int probe_wdl(Board &b, int *success) {
+    PROFILE_SCOPE(PROFILE_TB_PROBE);
+    uint64 key = b.getZobristKey();
+    std::atomic<uint64> &slot = WDL_cache[key & ((1 << WDL_CACHE_BITS) - 1)];
+    uint64 entry = slot.load(std::memory_order_relaxed);
+    if (entry != 0 && ((entry ^ key) & ~0xFFULL) == 0) {
+        *success = (int) ((entry >> 4) & 0xF);
+        return ((int) (entry & 0xF)) - 2;
+    }
+
+    int v = probe_wdl_uncached(b, success);
+    if (*success != 0)
+        slot.store((key & ~0xFFULL) | ((uint64) *success << 4) | (uint64) (v + 2),
+            std::memory_order_relaxed);
+    return v;
+}
+
+void clear_tb_cache() {
+    for (int i = 0; i < (1 << WDL_CACHE_BITS); i++)
+        WDL_cache[i].store(0, std::memory_order_relaxed);
+}
+
+// Maps the WDL table for the material in pcs[16], if it exists and has not
+// been loaded yet, and asks the OS to start reading it in.
+static void warm_table_wdl(int *pcs) {
+    uint64 key = calc_key_from_pcs(pcs, 0);
+    struct TBHashEntry *ptr2 = TB_hash[key >> (64 - TBHASHBITS)];
+    int i;
+    for (i = 0; i < HSHMAX; i++)
+        if (ptr2[i].key == key) break;
+    if (i == HSHMAX)
+        return;
+
+    struct TBEntry *ptr = ptr2[i].ptr;
+    if (ptr->ready)
+        return;
+    LOCK(TB_mutex);
+    if (!ptr->ready) {
+        char str[16];
+        prt_str_from_pcs(pcs, str, ptr->key != key);
+        if (!init_table_wdl(ptr, str)) {
+            ptr2[i].key = 0ULL;
+            UNLOCK(TB_mutex);
+            return;
+        }
+#ifndef __WIN32__
+        madvise(ptr->data, ptr->mapping, MADV_WILLNEED);
+#endif
+        __asm__ __volatile__ ("" ::: "memory");
+        ptr->ready = 1;
+    }
+    UNLOCK(TB_mutex);
+}
+
+// Enumerates the material combinations for one side that are reachable from
+// the root counts root[0..4] (pawns, knights, bishops, rooks, queens) by
+// captures and promotions, with at most maxPieces non-king pieces.
+static void get_reachable_material(const int *root, int maxPieces,
+        std::vector<std::vector<int>> &result) {
+    int c[5];
+    for (c[0] = 0; c[0] <= std::min(root[0], maxPieces); c[0]++)
+    for (c[1] = 0; c[0] + c[1] <= maxPieces; c[1]++)
+    for (c[2] = 0; c[0] + c[1] + c[2] <= maxPieces; c[2]++)
+    for (c[3] = 0; c[0] + c[1] + c[2] + c[3] <= maxPieces; c[3]++)
+    for (c[4] = 0; c[0] + c[1] + c[2] + c[3] + c[4] <= maxPieces; c[4]++) {
+        // Each piece beyond the root count must come from a promoted pawn
+        int promoted = 0;
+        for (int pt = KNIGHTS; pt <= QUEENS; pt++)
+            promoted += std::max(0, c[pt] - root[pt]);
+        if (promoted <= root[0] - c[0])
+            result.push_back(std::vector<int>(c, c + 5));
+    }
+}
+
+// Warm-up thread: goes through the reachable tables from the most to the
+// fewest pieces, since the largest ones are probed first.
+static void warm_tablebases(int *rootPcs) {
+    int maxPieces = TBlargest - 2;
+    std::vector<std::vector<int>> sides[2];
+    get_reachable_material(rootPcs + 1, maxPieces, sides[0]);
+    get_reachable_material(rootPcs + 9, maxPieces, sides[1]);
+
+    for (int total = maxPieces; total >= 1; total--) {
+        for (unsigned int w = 0; w < sides[0].size(); w++) {
+            for (unsigned int k = 0; k < sides[1].size(); k++) {
+                if (warmupStop)
+                    return;
+                int pcs[16] = {0};
+                int n = 0;
+                for (int pt = PAWNS; pt <= QUEENS; pt++) {
+                    pcs[pt + 1] = sides[0][w][pt];
+                    pcs[8 + pt + 1] = sides[1][k][pt];
+                    n += pcs[pt + 1] + pcs[8 + pt + 1];
+                }
+                if (n != total)
+                    continue;
+                pcs[KINGS + 1] = pcs[8 + KINGS + 1] = 1;
+                warm_table_wdl(pcs);
+            }
+        }
+    }
+}
+
+// Stops the warm-up thread, which must be done before the tables are freed.
+void stop_tb_warmup() {
+    if (warmupThread.joinable()) {
+        warmupStop = true;
+        warmupThread.join();
+    }
+    warmupStop = false;
+    warmupKey = 0;
+}
+
+// Starts mapping the WDL tables reachable from the root material in the
+// background, unless the root material has not changed since the last call.
+void start_tb_warmup(Board &b) {
+    if (TBlargest == 0)
+        return;
+    uint64 key = calc_key(b, 0);
+    if (key == warmupKey)
+        return;
+
+    stop_tb_warmup();
+    warmupKey = key;
+    static int rootPcs[16];
+    for (int i = 0; i < 16; i++)
+        rootPcs[i] = 0;
+    for (int pt = PAWNS; pt <= KINGS; pt++) {
+        rootPcs[pt + 1] = count(b.getPieces(WHITE, pt));
+        rootPcs[8 + pt + 1] = count(b.getPieces(BLACK, pt));
+    }
+    warmupThread = std::thread(warm_tablebases, rootPcs);
+}
+
 static int wdl_to_dtz[] = {
     -1, -101, 0, 101, 1
 };
@@ -488,6 +655,7 @@ static int wdl_to_dtz[] = {
 // then do not accept moves leading to dtz + 50-move-counter == 100.
 //
 int probe_dtz(Board &b, int *success) {
+    PROFILE_SCOPE(PROFILE_TB_PROBE);
     int wdl = probe_wdl(b, success);
     if (*success == 0) return 0;
 
@@ -28,6 +28,9 @@ extern int TBlargest; // 5 if 5-piece tables, 6 if 6-piece tables were found.
 void init_tablebases(char *path);
 int probe_wdl(Board &b, int *success);
 int probe_dtz(Board &b, int *success);
+void clear_tb_cache();
+void start_tb_warmup(Board &b);
+void stop_tb_warmup();
 int root_probe(Board *b, MoveList &rootMoves, ScoreList &scores, int &TBScore);
 int root_probe_wdl(Board *b, MoveList &rootMoves, ScoreList &scores, int &TBScore);
 
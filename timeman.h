@@ -19,10 +19,12 @@
 #ifndef __TIME_H__
 #define __TIME_H__
 
+#include <cstdint>
+
 // Search modes
 const int TIME = 1;
 const int DEPTH = 2;
-// const int NODES = 3;
+const int NODES = 3;
 const int MOVETIME = 4;
 
 // Time management constants
@@ -33,12 +35,18 @@ const double TIME_FACTOR = 0.85; // timeFactor = log b / (b - 1) where b is bran
 const double MAX_TIME_FACTOR = 4.0; // do not spend more than this multiple of time over the limit
 const double ALLOTMENT_FACTORS[8] = {1.0, 0.99, 0.40, 0.30, 0.25, 0.22, 0.20, 0.18};
 const double MAX_USAGE_FACTORS[8] = {1.0, 0.99, 0.72, 0.63, 0.59, 0.56, 0.54, 0.52};
+// The main thread checks the clock after searching this many moves
+const int TIME_CHECK_INTERVAL = 1024;
+// For node-limited searches the thread node counts are summed this often
+const int NODE_CHECK_INTERVAL = 16;
 
 struct TimeManagement {
     int searchMode;
     int allotment;
     // Hard limit on time usage for this move, only for time-based searches
     int maxAllotment;
+    // Node limit summed over all threads, only for node-limited searches
+    uint64_t nodes;
 };
 
 #endif
\ No newline at end of file
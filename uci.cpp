@@ -18,9 +18,14 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cctype>
 #include <cmath>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <vector>
 #include <thread>
@@ -67,19 +72,69 @@ string boardToString(Board &board);
 bool equalsIgnoreCase(const std::string &s1, const std::string &s2);
 void stringToLowerCase(std::string &s);
 void clearAll(Board &board);
+// Output formats for bench
+enum BenchFormat {
+    BENCH_TEXT, BENCH_JSON, BENCH_CSV
+};
+
+struct BenchOptions {
+    int depth;
+    // An EPD or FEN file of positions to use instead of the built-in ones
+    string file;
+    // The thread count to bench with, and the hash size in MB (0 to keep the
+    // current settings)
+    int threads;
+    uint64_t hashMB;
+    BenchFormat format;
+    // A file to write the results to instead of stderr
+    string outFile;
+    // Bench at 1, 2, 4 ... threads and report the scaling
+    bool sweep;
+
+    BenchOptions() : depth(11), threads(0), hashMB(0), format(BENCH_TEXT),
+        sweep(false) {}
+};
+
+void bench(Board &board, const BenchOptions &options);
+ThreadBinding parseThreadBinding(const string &name);
 uint64_t perft(Board &b, int color, int depth, uint64_t &captures);
+void perftDivide(Board &b, int depth);
 
 
 static int BUFFER_TIME = DEFAULT_BUFFER_TIME;
+// Whether to map the tablebases reachable from the root in the background
+static bool syzygyWarmup = false;
 MoveList movesToSearch;
 TimeManagement timeParams;
 // Declared in search.cpp
 extern std::atomic<bool> isStop;
 extern std::atomic<bool> stopSignal;
 
+/*
+ * A line queued for the output thread. If hasHashfull is set, the output
+ * thread inserts " hashfull <n>" between the two parts, so that the table
+ * sampling is not done on the search thread.
+ */
+struct OutputLine {
+    string text;
+    string suffix;
+    bool hasHashfull;
+    uint8_t hashAge;
+};
+
+static std::deque<OutputLine> outputQueue;
+static std::mutex outputMutex;
+static std::condition_variable outputCV;
+// Signalled when the output thread has written everything queued
+static std::condition_variable outputDrainedCV;
+static bool outputBusy = false;
+static std::thread outputThread;
+static bool outputExit = false;
+
 
 int main() {
-    initMagicTables(2563762638929852183ULL);
+    startOutputThread();
+    initMagicTables();
     initPSQT();
     initZobristTable();
     initInBetweenTable();
@@ -89,6 +144,8 @@ int main() {
     setNumThreads(DEFAULT_THREADS);
 
     string input;
+    // The input before it is lowercased, for file paths
+    string rawInput;
     std::vector<string> inputVector;
     string name = "Laser";
     string version = "1.6 beta";
@@ -100,7 +157,8 @@ int main() {
     cout << name << " " << version << " by " << author << endl;
 
     while (input != "quit") {
-        getline(std::cin, input);
+        getline(std::cin, rawInput);
+        input = rawInput;
         stringToLowerCase(input);
         inputVector = split(input, ' ');
         std::cin.clear();
@@ -110,27 +168,41 @@ int main() {
             continue;
 
         if (input == "uci") {
-            cout << "id name " << name << " " << version << endl;
-            cout << "id author " << author << endl;
-            cout << "option name Threads type spin default " << DEFAULT_THREADS
-                 << " min " << MIN_THREADS << " max " << MAX_THREADS << endl;
-            cout << "option name Hash type spin default " << DEFAULT_HASH_SIZE
-                 << " min " << MIN_HASH_SIZE << " max " << MAX_HASH_SIZE << endl;
-            cout << "option name EvalCache type spin default " << DEFAULT_HASH_SIZE
-                 << " min " << MIN_HASH_SIZE << " max " << MAX_HASH_SIZE << endl;
-            cout << "option name Ponder type check default false" << endl;
-            cout << "option name MultiPV type spin default " << DEFAULT_MULTI_PV
-                 << " min " << MIN_MULTI_PV << " max " << MAX_MULTI_PV << endl;
-            cout << "option name BufferTime type spin default " << DEFAULT_BUFFER_TIME
-                 << " min " << MIN_BUFFER_TIME << " max " << MAX_BUFFER_TIME << endl;
-            cout << "option name SyzygyPath type string default <empty>" << endl;
-            cout << "option name ScaleMaterial type spin default " << DEFAULT_EVAL_SCALE
-                 << " min " << MIN_EVAL_SCALE << " max " << MAX_EVAL_SCALE << endl;
-            cout << "option name ScaleKingSafety type spin default " << DEFAULT_EVAL_SCALE
-                 << " min " << MIN_EVAL_SCALE << " max " << MAX_EVAL_SCALE << endl;
-            cout << "uciok" << endl;
+            // Sent as one block so that it is not interleaved with other output
+            std::ostringstream reply;
+            reply << "id name " << name << " " << version << '\n';
+            reply << "id author " << author << '\n';
+            reply << "option name Threads type spin default " << DEFAULT_THREADS
+                  << " min " << MIN_THREADS << " max " << MAX_THREADS << '\n';
+            reply << "option name Hash type spin default " << DEFAULT_HASH_SIZE
+                  << " min " << MIN_HASH_SIZE << " max " << MAX_HASH_SIZE << '\n';
+            reply << "option name EvalCache type spin default " << DEFAULT_HASH_SIZE
+                  << " min " << MIN_HASH_SIZE << " max " << MAX_HASH_SIZE << '\n';
+            reply << "option name Ponder type check default false\n";
+            reply << "option name SharedHistory type check default false\n";
+            reply << "option name NumaInterleave type check default false\n";
+            reply << "option name ThreadBinding type combo default None var None var Cores var Nodes\n";
+            reply << "option name SMPMode type combo default Lazy var Lazy var ABDADA\n";
+            reply << "option name MultiPV type spin default " << DEFAULT_MULTI_PV
+                  << " min " << MIN_MULTI_PV << " max " << MAX_MULTI_PV << '\n';
+            reply << "option name BufferTime type spin default " << DEFAULT_BUFFER_TIME
+                  << " min " << MIN_BUFFER_TIME << " max " << MAX_BUFFER_TIME << '\n';
+            reply << "option name InfoInterval type spin default " << DEFAULT_INFO_INTERVAL
+                  << " min " << MIN_INFO_INTERVAL << " max " << MAX_INFO_INTERVAL << '\n';
+            reply << "option name SearchReuse type check default true\n";
+            reply << "option name ReuseDepthOffset type spin default " << DEFAULT_REUSE_DEPTH_OFFSET
+                  << " min " << MIN_REUSE_DEPTH_OFFSET << " max " << MAX_REUSE_DEPTH_OFFSET << '\n';
+            reply << "option name SyzygyPath type string default <empty>\n";
+            reply << "option name SyzygyWarmup type check default false\n";
+            reply << "option name ScaleMaterial type spin default " << DEFAULT_EVAL_SCALE
+                  << " min " << MIN_EVAL_SCALE << " max " << MAX_EVAL_SCALE << '\n';
+            reply << "option name ScaleKingSafety type spin default " << DEFAULT_EVAL_SCALE
+                  << " min " << MIN_EVAL_SCALE << " max " << MAX_EVAL_SCALE << '\n';
+            reply << "uciok";
+            sendOutput(reply.str());
         }
-        else if (input == "isready") cout << "readyok" << endl;
+        // Queued so that it follows any search output sent before it
+        else if (input == "isready") sendOutput("readyok");
         else if (input == "ucinewgame") clearAll(board);
         else if (input.substr(0, 8) == "position") setPosition(input, inputVector, board);
         else if (input.substr(0, 2) == "go" && isStop) {
@@ -158,6 +230,12 @@ int main() {
                 it++;
                 timeParams.allotment = std::stoi(*it);
             }
+            else if (input.find("nodes") != string::npos && inputVector.size() > 2) {
+                timeParams.searchMode = NODES;
+                it = find(inputVector.begin(), inputVector.end(), "nodes");
+                it++;
+                timeParams.nodes = std::max(1ULL, std::stoull(*it));
+            }
             else if (input.find("depth") != string::npos && inputVector.size() > 2) {
                 timeParams.searchMode = DEPTH;
                 it = find(inputVector.begin(), inputVector.end(), "depth");
@@ -216,6 +294,9 @@ int main() {
                 }
             }
 
+            if (syzygyWarmup)
+                start_tb_warmup(board);
+
             isStop = false;
             stopSignal = false;
             searchThread = std::thread(getBestMove, &board, &timeParams, &movesToSearch);
@@ -233,7 +314,7 @@ int main() {
         }
         else if (input.substr(0, 9) == "setoption" && inputVector.size() >= 5) {
             if (inputVector.at(1) != "name" || inputVector.at(3) != "value") {
-                cout << "info string Invalid option format." << endl;
+                sendOutput("info string Invalid option format.");
             }
             else {
                 if (inputVector.at(2) == "threads") {
@@ -263,6 +344,18 @@ int main() {
                 else if (inputVector.at(2) == "ponder") {
                     // do nothing
                 }
+                else if (inputVector.at(2) == "sharedhistory") {
+                    setSharedHistory(equalsIgnoreCase(inputVector.at(4), "true"));
+                }
+                else if (inputVector.at(2) == "numainterleave") {
+                    setNumaInterleave(equalsIgnoreCase(inputVector.at(4), "true"));
+                }
+                else if (inputVector.at(2) == "threadbinding") {
+                    setThreadBinding(parseThreadBinding(inputVector.at(4)));
+                }
+                else if (inputVector.at(2) == "smpmode") {
+                    setSMPMode(equalsIgnoreCase(inputVector.at(4), "abdada") ? SMP_ABDADA : SMP_LAZY);
+                }
                 else if (inputVector.at(2) == "multipv") {
                     int multiPV = std::stoi(inputVector.at(4));
                     if (multiPV < MIN_MULTI_PV)
@@ -278,15 +371,49 @@ int main() {
                     if (BUFFER_TIME > MAX_BUFFER_TIME)
                         BUFFER_TIME = MAX_BUFFER_TIME;
                 }
+                else if (inputVector.at(2) == "infointerval") {
+                    int interval = std::stoi(inputVector.at(4));
+                    if (interval < MIN_INFO_INTERVAL)
+                        interval = MIN_INFO_INTERVAL;
+                    if (interval > MAX_INFO_INTERVAL)
+                        interval = MAX_INFO_INTERVAL;
+                    setInfoInterval(interval);
+                }
+                else if (inputVector.at(2) == "searchreuse") {
+                    setSearchReuse(equalsIgnoreCase(inputVector.at(4), "true"));
+                }
+                else if (inputVector.at(2) == "reusedepthoffset") {
+                    int offset = std::stoi(inputVector.at(4));
+                    if (offset < MIN_REUSE_DEPTH_OFFSET)
+                        offset = MIN_REUSE_DEPTH_OFFSET;
+                    if (offset > MAX_REUSE_DEPTH_OFFSET)
+                        offset = MAX_REUSE_DEPTH_OFFSET;
+                    setReuseDepthOffset(offset);
+                }
                 else if (inputVector.at(2) == "syzygypath") {
-                    string path = inputVector.at(4);
-                    for (unsigned int i = 5; i < inputVector.size(); i++) {
-                        path += string(" ") + inputVector.at(i);
+                    // Paths are case sensitive, so take them from the raw input
+                    std::vector<string> rawVector = split(rawInput, ' ');
+                    string path = rawVector.at(4);
+                    for (unsigned int i = 5; i < rawVector.size(); i++) {
+                        path += string(" ") + rawVector.at(i);
                     }
                     char *c_path = (char *) malloc(path.length() + 1);
                     std::strcpy(c_path, path.c_str());
+                    // The warm-up thread must not touch the tables while
+                    // they are freed and reloaded
+                    stop_tb_warmup();
                     init_tablebases(c_path);
+                    clear_tb_cache();
                     free(c_path);
+                    if (syzygyWarmup)
+                        start_tb_warmup(board);
+                }
+                else if (inputVector.at(2) == "syzygywarmup") {
+                    syzygyWarmup = equalsIgnoreCase(inputVector.at(4), "true");
+                    if (syzygyWarmup)
+                        start_tb_warmup(board);
+                    else
+                        stop_tb_warmup();
                 }
                 else if (inputVector.at(2) == "scalematerial") {
                     int scale = std::stoi(inputVector.at(4));
@@ -305,12 +432,17 @@ int main() {
                     setKingSafetyScale(scale);
                 }
                 else
-                    cout << "info string Invalid option." << endl;
+                    sendOutput("info string Invalid option.");
             }
         }
 
         //----------------------------Non-UCI Commands--------------------------
         else if (input == "board") cerr << boardToString(board);
+        else if (input.substr(0, 5) == "perft" && inputVector.size() == 3
+              && inputVector.at(2) == "divide") {
+            // Usage: perft <depth> divide
+            perftDivide(board, std::stoi(inputVector.at(1)));
+        }
         else if (input.substr(0, 5) == "perft" && inputVector.size() == 2) {
             int depth = std::stoi(inputVector.at(1));
 
@@ -327,43 +459,179 @@ int main() {
             cerr << "Nodes/second: " << 1000 * nodes / time << endl;
         }
         else if (input.substr(0, 5) == "bench") {
-            auto startTime = ChessClock::now();
-            uint64_t totalNodes = 0;
-            movesToSearch.clear();
-            timeParams.searchMode = DEPTH;
-            timeParams.allotment = 11;
-            // Allow an alternate bench depth argument
-            if (inputVector.size() == 2)
-                timeParams.allotment = std::stoi(inputVector.at(1));
-
-            for (unsigned int i = 0; i < positions.size(); i++) {
-                clearAll(board);
-                board = fenToBoard(positions.at(i));
-
-                isStop = false;
-                stopSignal = false;
-                getBestMove(&board, &timeParams, &movesToSearch);
-                isStop = true;
-                stopSignal = true;
-
-                totalNodes += getNodes();
+            // Usage: bench [compare] [depth] [file <epd>] [threads <n>]
+            //        [hash <MB>] [format text|json|csv] [out <file>] [sweep]
+            //        [binding cores|nodes]
+            // The compare mode runs the bench with private and then shared
+            // history tables. The binding mode runs it with unpinned threads
+            // and then with the given thread binding.
+            std::vector<string> rawVector = split(rawInput, ' ');
+            BenchOptions options;
+            bool compare = false;
+            ThreadBinding binding = BIND_NONE;
+            for (unsigned int i = 1; i < inputVector.size(); i++) {
+                const string &arg = inputVector.at(i);
+                bool hasValue = (i + 1 < inputVector.size());
+                if (arg == "compare")
+                    compare = true;
+                else if (arg == "sweep")
+                    options.sweep = true;
+                else if (arg == "binding" && hasValue)
+                    binding = parseThreadBinding(inputVector.at(++i));
+                else if (arg == "file" && hasValue)
+                    options.file = rawVector.at(++i);
+                else if (arg == "out" && hasValue)
+                    options.outFile = rawVector.at(++i);
+                else if (arg == "threads" && hasValue)
+                    options.threads = std::max(1, std::min(MAX_THREADS, std::stoi(inputVector.at(++i))));
+                else if (arg == "hash" && hasValue)
+                    options.hashMB = std::min(MAX_HASH_SIZE, (uint64_t) std::max(1, std::stoi(inputVector.at(++i))));
+                else if (arg == "format" && hasValue) {
+                    const string &format = inputVector.at(++i);
+                    options.format = (format == "json") ? BENCH_JSON
+                                   : (format == "csv")  ? BENCH_CSV : BENCH_TEXT;
+                }
+                // Allow an alternate bench depth argument
+                else if (!arg.empty() && std::isdigit(arg.at(0)))
+                    options.depth = std::stoi(arg);
             }
 
-            uint64_t time = getTimeElapsed(startTime);
-
-            clearAll(board);
-
-            cerr << "Nodes: " << totalNodes << endl;
-            cerr << "Time: " << time << endl;
-            cerr << "Nodes/second: " << 1000 * totalNodes / time << endl;
+            if (compare) {
+                bool wasShared = getSharedHistory();
+                cerr << "SharedHistory false:" << endl;
+                setSharedHistory(false);
+                bench(board, options);
+                cerr << "SharedHistory true:" << endl;
+                setSharedHistory(true);
+                bench(board, options);
+                setSharedHistory(wasShared);
+            }
+            else if (binding != BIND_NONE) {
+                ThreadBinding oldBinding = getThreadBinding();
+                cerr << "ThreadBinding None:" << endl;
+                setThreadBinding(BIND_NONE);
+                bench(board, options);
+                cerr << "ThreadBinding " << (binding == BIND_CORES ? "Cores" : "Nodes")
+                     << ":" << endl;
+                setThreadBinding(binding);
+                bench(board, options);
+                setThreadBinding(oldBinding);
+            }
+            else
+                bench(board, options);
+        }
+        else if (input.substr(0, 9) == "savehash " && inputVector.size() >= 2) {
+            // Usage: savehash <file>
+            size_t pathStart = rawInput.find_first_not_of(' ', 9);
+            if (pathStart == string::npos) {
+                cerr << "Usage: savehash <file>" << endl;
+                continue;
+            }
+            string path = rawInput.substr(pathStart);
+            if (saveHashTable(path))
+                cerr << "Saved hash table to " << path << endl;
+            else
+                cerr << "Could not save hash table to " << path << endl;
+        }
+        else if (input.substr(0, 9) == "loadhash " && inputVector.size() >= 2) {
+            // Usage: loadhash <file>
+            size_t pathStart = rawInput.find_first_not_of(' ', 9);
+            if (pathStart == string::npos) {
+                cerr << "Usage: loadhash <file>" << endl;
+                continue;
+            }
+            string path = rawInput.substr(pathStart);
+            if (loadHashTable(path))
+                cerr << "Loaded hash table from " << path << endl;
+            else
+                cerr << "Could not load hash table from " << path << endl;
         }
         else if (input == "eval") {
             Eval e;
             e.evaluate<true>(board);
         }
+        // Show the hot path profile of all searches since it was last cleared
+        else if (input == "stats")
+            printProfile();
+        else if (input == "stats clear")
+            clearProfile();
 
         // According to UCI protocol, inputs that do not make sense are ignored
     }
+
+    // Stop any search still running and join the helper threads before exiting
+    isStop = true;
+    stopSignal = true;
+    stopHelperThreads();
+    stop_tb_warmup();
+    stopOutputThread();
+}
+
+// Writes queued lines until told to exit, flushing once per batch
+void outputThreadLoop() {
+    std::unique_lock<std::mutex> lock(outputMutex);
+    while (true) {
+        outputCV.wait(lock, [] { return outputExit || !outputQueue.empty(); });
+        if (outputQueue.empty())
+            break;
+
+        std::deque<OutputLine> lines;
+        lines.swap(outputQueue);
+        outputBusy = true;
+        lock.unlock();
+
+        for (unsigned int i = 0; i < lines.size(); i++) {
+            cout << lines[i].text;
+            if (lines[i].hasHashfull)
+                cout << " hashfull " << getHashfull(lines[i].hashAge) << lines[i].suffix;
+            cout << '\n';
+        }
+        cout.flush();
+        lock.lock();
+        outputBusy = false;
+        if (outputQueue.empty())
+            outputDrainedCV.notify_all();
+    }
+}
+
+// Waits until all queued output has been written. Since the output thread
+// samples the transposition table for hashfull, this must be called before
+// the table is reallocated.
+void waitForOutput() {
+    std::unique_lock<std::mutex> lock(outputMutex);
+    outputDrainedCV.wait(lock, [] { return outputQueue.empty() && !outputBusy; });
+}
+
+void startOutputThread() {
+    outputExit = false;
+    outputThread = std::thread(outputThreadLoop);
+}
+
+// Writes any remaining output and stops the output thread
+void stopOutputThread() {
+    {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        outputExit = true;
+    }
+    outputCV.notify_one();
+    outputThread.join();
+}
+
+void sendOutput(const string &line) {
+    {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        outputQueue.push_back({line, "", false, 0});
+    }
+    outputCV.notify_one();
+}
+
+// Sends an info line with the hashfull for the given age between the parts
+void sendInfo(const string &prefix, uint8_t hashAge, const string &suffix) {
+    {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        outputQueue.push_back({prefix, suffix, true, hashAge});
+    }
+    outputCV.notify_one();
 }
 
 void setPosition(string &input, std::vector<string> &inputVector, Board &board) {
@@ -599,6 +867,198 @@ void clearAll(Board &board) {
     board = fenToBoard(STARTPOS);
 }
 
+// Reads the positions of an EPD or FEN file, one per line. EPD operations
+// after the first four fields are ignored.
+bool readBenchPositions(const string &path, std::vector<string> &fens) {
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    string line;
+    while (getline(file, line)) {
+        std::vector<string> fields;
+        std::stringstream ss(line);
+        string field;
+        while (ss >> field)
+            fields.push_back(field);
+        if (fields.size() < 4 || fields.at(0).at(0) == '#')
+            continue;
+
+        // Keep the move counters of a full FEN
+        bool hasCounters = fields.size() >= 6
+            && std::isdigit(fields.at(4).at(0)) && std::isdigit(fields.at(5).at(0));
+        string fen = fields.at(0);
+        for (unsigned int i = 1; i < (hasCounters ? 6u : 4u); i++)
+            fen += " " + fields.at(i);
+        fens.push_back(fen);
+    }
+    return true;
+}
+
+double getHitRate(uint64_t hits, uint64_t probes) {
+    return (probes == 0) ? 0 : (double) hits / (double) probes;
+}
+
+// Searches each position to a fixed depth, printing per-position results in
+// the JSON and CSV formats. Returns the total nodes, and the total time
+// through the time argument.
+uint64_t benchPositions(Board &board, const std::vector<string> &fens,
+        const BenchOptions &options, std::ostream &out, uint64_t &time) {
+    auto startTime = ChessClock::now();
+    uint64_t totalNodes = 0;
+    movesToSearch.clear();
+    timeParams.searchMode = DEPTH;
+    timeParams.allotment = options.depth;
+
+    if (options.format == BENCH_JSON)
+        out << "  \"positions\": [" << endl;
+    else if (options.format == BENCH_CSV)
+        out << "position,fen,nodes,time,depth,seldepth,tt_hit_rate,eval_cache_hit_rate" << endl;
+
+    for (unsigned int i = 0; i < fens.size(); i++) {
+        clearAll(board);
+        board = fenToBoard(fens.at(i));
+
+        auto searchStart = ChessClock::now();
+        isStop = false;
+        stopSignal = false;
+        getBestMove(&board, &timeParams, &movesToSearch);
+        isStop = true;
+        stopSignal = true;
+        uint64_t searchTime = getTimeElapsed(searchStart);
+
+        SearchSummary summary = getSearchSummary();
+        totalNodes += summary.nodes;
+        double ttHitRate = getHitRate(summary.hashHits, summary.hashProbes);
+        double evalCacheHitRate = getHitRate(summary.evalCacheHits, summary.evalCacheProbes);
+
+        if (options.format == BENCH_JSON) {
+            out << "    {\"position\": " << i + 1 << ", \"fen\": \"" << fens.at(i)
+                << "\", \"nodes\": " << summary.nodes << ", \"time\": " << searchTime
+                << ", \"depth\": " << summary.depth
+                << ", \"seldepth\": " << summary.selectiveDepth
+                << ", \"tt_hit_rate\": " << ttHitRate
+                << ", \"eval_cache_hit_rate\": " << evalCacheHitRate << "}"
+                << (i + 1 < fens.size() ? "," : "") << endl;
+        }
+        else if (options.format == BENCH_CSV) {
+            out << i + 1 << ",\"" << fens.at(i) << "\"," << summary.nodes << ","
+                << searchTime << "," << summary.depth << "," << summary.selectiveDepth
+                << "," << ttHitRate << "," << evalCacheHitRate << endl;
+        }
+    }
+
+    time = getTimeElapsed(startTime);
+    clearAll(board);
+
+    if (options.format == BENCH_JSON)
+        out << "  ]," << endl;
+    return totalNodes;
+}
+
+// Reads the value of the ThreadBinding option
+ThreadBinding parseThreadBinding(const string &name) {
+    if (equalsIgnoreCase(name, "cores"))
+        return BIND_CORES;
+    if (equalsIgnoreCase(name, "nodes"))
+        return BIND_NODES;
+    return BIND_NONE;
+}
+
+/*
+ * Searches each bench position to a fixed depth and reports the total nodes
+ * and speed. The sweep mode repeats the bench at 1, 2, 4 ... up to the
+ * selected number of threads, reporting the time to depth and the speedup
+ * over one thread.
+ */
+void bench(Board &board, const BenchOptions &options) {
+    std::vector<string> fens;
+    if (options.file.empty())
+        fens = positions;
+    else if (!readBenchPositions(options.file, fens) || fens.empty()) {
+        cerr << "Could not read bench positions from " << options.file << endl;
+        return;
+    }
+
+    std::ofstream outFile;
+    if (!options.outFile.empty()) {
+        outFile.open(options.outFile);
+        if (!outFile) {
+            cerr << "Could not open " << options.outFile << endl;
+            return;
+        }
+    }
+    std::ostream &out = options.outFile.empty() ? cerr : outFile;
+
+    int oldThreads = getNumThreads();
+    uint64_t oldHashMB = getHashSize();
+    int maxThreads = (options.threads > 0) ? options.threads : oldThreads;
+    if (options.hashMB > 0)
+        setHashSize(options.hashMB);
+
+    std::vector<int> threadCounts;
+    if (options.sweep) {
+        for (int n = 1; n < maxThreads; n *= 2)
+            threadCounts.push_back(n);
+    }
+    threadCounts.push_back(maxThreads);
+
+    if (options.format == BENCH_JSON) {
+        out << "{" << endl;
+        out << "  \"depth\": " << options.depth << ", \"hash\": " << getHashSize() << "," << endl;
+    }
+    else if (options.format == BENCH_CSV && options.sweep)
+        out << "threads,nodes,time,nps,speedup" << endl;
+
+    uint64_t baseTime = 0;
+    for (unsigned int t = 0; t < threadCounts.size(); t++) {
+        int threads = threadCounts.at(t);
+        setNumThreads(threads);
+
+        if (options.format == BENCH_JSON)
+            out << (t == 0 ? "  \"runs\": [" : "  ,") << endl << "  {" << endl
+                << "  \"threads\": " << threads << "," << endl;
+
+        uint64_t time;
+        // The per-position CSV rows of a sweep are left out to keep a single table
+        BenchOptions runOptions = options;
+        if (options.sweep && options.format == BENCH_CSV)
+            runOptions.format = BENCH_TEXT;
+        uint64_t nodes = benchPositions(board, fens, runOptions, out, time);
+        if (t == 0)
+            baseTime = time;
+        double speedup = (double) baseTime / (double) time;
+
+        if (options.format == BENCH_JSON) {
+            out << "  \"nodes\": " << nodes << ", \"time\": " << time
+                << ", \"nps\": " << 1000 * nodes / time
+                << ", \"speedup\": " << speedup << endl << "  }" << endl;
+        }
+        else if (options.format == BENCH_CSV) {
+            if (options.sweep)
+                out << threads << "," << nodes << "," << time << ","
+                    << 1000 * nodes / time << "," << speedup << endl;
+        }
+        else {
+            if (options.sweep)
+                out << "Threads: " << threads << endl;
+            out << "Nodes: " << nodes << endl;
+            out << "Time: " << time << endl;
+            out << "Nodes/second: " << 1000 * nodes / time << endl;
+            if (options.sweep)
+                out << "Speedup: " << speedup << endl;
+        }
+    }
+
+    if (options.format == BENCH_JSON)
+        out << "  ]" << endl << "}" << endl;
+
+    if (getNumThreads() != oldThreads)
+        setNumThreads(oldThreads);
+    if (getHashSize() != oldHashMB)
+        setHashSize(oldHashMB);
+}
+
 /*
  * Performs a PERFT (performance test). Useful for testing/debugging
  * PERFT n counts the number of possible positions after n moves by either side,
@@ -619,18 +1079,136 @@ uint64_t perft(Board &b, int color, int depth, uint64_t &captures) {
 
     uint64_t nodes = 0;
 
-    MoveList pl;
-    b.getAllPseudoLegalMoves(pl, color);
+    MoveList pl = b.getAllLegalMoves(color);
     for (unsigned int i = 0; i < pl.size(); i++) {
-        Board copy = b.staticCopy();
-        if (!copy.doPseudoLegalMove(pl.get(i), color))
-            continue;
-
         if (isCapture(pl.get(i)))
             captures++;
+    }
+    // The moves are all legal, so the last ply need not be made
+    if (depth == 1)
+        return pl.size();
 
-        nodes += perft(copy, color^1, depth-1, captures);
+    for (unsigned int i = 0; i < pl.size(); i++) {
+        UndoInfo undo;
+        b.doMove(pl.get(i), color, undo);
+        nodes += perft(b, color^1, depth-1, captures);
+        b.undoMove(pl.get(i), color, undo);
     }
 
     return nodes;
 }
+
+/*
+ * Perft hash entries store the node and capture counts of a subtree. Entries
+ * are shared between threads without locking, so like the transposition table
+ * the key is XORed with the data to detect entries torn by a race.
+ */
+struct PerftHashEntry {
+    uint64_t check;
+    uint64_t nodes;
+    uint64_t captures;
+    uint64_t depth;
+};
+
+const uint64_t PERFT_HASH_ENTRIES = 1 << 21;
+
+// The same as perft(), but with subtree counts cached in a hash table
+uint64_t perftHashed(Board &b, int color, int depth, uint64_t &captures,
+        PerftHashEntry *perftHash) {
+    if (depth <= 1)
+        return perft(b, color, depth, captures);
+
+    uint64_t key = b.getZobristKey();
+    PerftHashEntry *entry = perftHash + (key & (PERFT_HASH_ENTRIES - 1));
+    PerftHashEntry cached = *entry;
+    if (cached.depth == (uint64_t) depth
+     && (cached.check ^ cached.nodes ^ cached.captures ^ cached.depth) == key) {
+        captures += cached.captures;
+        return cached.nodes;
+    }
+
+    uint64_t nodes = 0;
+    uint64_t subtreeCaptures = 0;
+    MoveList pl = b.getAllLegalMoves(color);
+    for (unsigned int i = 0; i < pl.size(); i++) {
+        if (isCapture(pl.get(i)))
+            subtreeCaptures++;
+
+        UndoInfo undo;
+        b.doMove(pl.get(i), color, undo);
+        nodes += perftHashed(b, color^1, depth-1, subtreeCaptures, perftHash);
+        b.undoMove(pl.get(i), color, undo);
+    }
+
+    PerftHashEntry newEntry = {key ^ nodes ^ subtreeCaptures ^ (uint64_t) depth,
+                               nodes, subtreeCaptures, (uint64_t) depth};
+    *entry = newEntry;
+    captures += subtreeCaptures;
+    return nodes;
+}
+
+/*
+ * A perft that splits the root moves between the search threads, sharing a
+ * perft hash table. Prints the node count of each root move (divide), and the
+ * speed of each thread.
+ */
+void perftDivide(Board &b, int depth) {
+    if (depth < 1)
+        return;
+
+    int color = b.getPlayerToMove();
+    MoveList rootMoves = b.getAllLegalMoves(color);
+    int threads = getNumThreads();
+    PerftHashEntry *perftHash = (PerftHashEntry *)
+        allocateTable(PERFT_HASH_ENTRIES * sizeof(PerftHashEntry));
+    clearTable(perftHash, PERFT_HASH_ENTRIES * sizeof(PerftHashEntry), threads);
+
+    std::vector<uint64_t> moveNodes(rootMoves.size());
+    std::vector<uint64_t> moveCaptures(rootMoves.size());
+    std::vector<uint64_t> threadNodes(threads);
+    std::vector<uint64_t> threadTimes(threads);
+    std::atomic<unsigned int> nextMove(0);
+
+    auto startTime = ChessClock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            ChessTime threadStart = ChessClock::now();
+            Board copy = b.staticCopy();
+            unsigned int i;
+            while ((i = nextMove++) < rootMoves.size()) {
+                Move m = rootMoves.get(i);
+                uint64_t captures = isCapture(m) ? 1 : 0;
+                UndoInfo undo;
+                copy.doMove(m, color, undo);
+                moveNodes[i] = (depth == 1) ? 1
+                    : perftHashed(copy, color^1, depth-1, captures, perftHash);
+                copy.undoMove(m, color, undo);
+                moveCaptures[i] = captures;
+                threadNodes[t] += moveNodes[i];
+            }
+            threadTimes[t] = getTimeElapsed(threadStart);
+        });
+    }
+    for (std::thread &w : workers)
+        w.join();
+    uint64_t time = getTimeElapsed(startTime);
+    freeTable(perftHash);
+
+    uint64_t nodes = 0, captures = 0;
+    for (unsigned int i = 0; i < rootMoves.size(); i++) {
+        cerr << moveToString(rootMoves.get(i)) << ": " << moveNodes[i] << endl;
+        nodes += moveNodes[i];
+        captures += moveCaptures[i];
+    }
+    cerr << endl;
+    for (int t = 0; t < threads; t++) {
+        cerr << "Thread " << t << ": " << threadNodes[t] << " nodes, "
+             << 1000 * threadNodes[t] / threadTimes[t] << " nodes/second" << endl;
+    }
+
+    cerr << "Nodes: " << nodes << endl;
+    cerr << "Captures: " << captures << endl;
+    cerr << "Time: " << time << endl;
+    cerr << "Nodes/second: " << 1000 * nodes / time << endl;
+}
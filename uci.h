@@ -37,8 +37,22 @@ const int MAX_BUFFER_TIME = 5000;
 const int DEFAULT_EVAL_SCALE = 100;
 const int MIN_EVAL_SCALE = 0;
 const int MAX_EVAL_SCALE = 500;
+const int DEFAULT_INFO_INTERVAL = 0;
+const int MIN_INFO_INTERVAL = 0;
+const int MAX_INFO_INTERVAL = 10000;
+const int DEFAULT_REUSE_DEPTH_OFFSET = 2;
+const int MIN_REUSE_DEPTH_OFFSET = 0;
+const int MAX_REUSE_DEPTH_OFFSET = 16;
 
 Board fenToBoard(std::string s);
 std::string boardToFEN(Board &board);
 
+// Output to the GUI, written by a separate thread so that the search never
+// blocks on stdout
+void startOutputThread();
+void stopOutputThread();
+void waitForOutput();
+void sendOutput(const std::string &line);
+void sendInfo(const std::string &prefix, uint8_t hashAge, const std::string &suffix);
+
 #endif